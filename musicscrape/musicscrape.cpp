@@ -20,30 +20,54 @@
 
 #include "musicscrape.hpp"
 #include "gumbo.h"
+#ifdef MUSICSCRAPE_TOKENIZER_BACKEND
+// Gumbo internals, for the tokenizer backend. Written against google/gumbo-parser 0.10.1, the
+// final release, which CMake checks for. The gumbo_tokenizer_*() functions, gumbo_lex(),
+// gumbo_token_destroy(), the _options and _output members of GumboParser and the max_errors
+// handling of gumbo_add_error() are not part of the public API.
+#include "parser.h"
+#include "tokenizer.h"
+#endif
 #include "rapidjson/document.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
 #include "rapidjson/pointer.h"
+#include "rapidjson/reader.h"
+#include "rapidjson/memorystream.h"
 
 #include <array>
-#include <functional>
 #include <algorithm>
+#include <chrono>
 #include <numeric>
 #include <iostream>
+#include <sstream>
+#include <mutex>
 #include <cstring>
+#include <cstdlib>
 
 using std::array;
 using std::pair;
 using std::string;
 using std::vector;
-using std::function;
 
-bool MUSIC_SCRAPE_LOG_ERRORS = false;
+std::atomic<bool> MUSIC_SCRAPE_LOG_ERRORS(false);
 
+/**
+ * Collects one log line, and writes it to stderr in one go, so that lines from
+ * concurrent parses don't get interleaved
+ */
 struct ScrapeLogger {
     ScrapeLogger() {}
-    ~ScrapeLogger() { std::cerr << std::endl; }
-    template <class T> ScrapeLogger &operator<<(const T &t) { std::cerr << t; return *this; }
+    ~ScrapeLogger()
+    {
+        m_line << '\n';
+        std::lock_guard<std::mutex> lock(mutex());
+        std::cerr << m_line.str() << std::flush;
+    }
+    template <class T> ScrapeLogger &operator<<(const T &t) { m_line << t; return *this; }
+
+    static std::mutex &mutex() { static std::mutex s_mutex; return s_mutex; }
+    std::ostringstream m_line;
 };
 
 #define SCRAPE_LOG() if (MUSIC_SCRAPE_LOG_ERRORS) ScrapeLogger() << "[Scrape: " << __LINE__ << "] "
@@ -109,6 +133,197 @@ static bool strStartsWith(const string &s, const string &sub)
     return s.find(sub, 0) == 0;
 }
 
+/**
+ * Finds the first occurrence of needle in [begin, end), without relying on NUL-termination
+ */
+static const char *memFind(const char *begin, const char *end, const char *needle, size_t needleLength)
+{
+    if (needleLength == 0)
+        return begin;
+
+    while ((size_t) (end - begin) >= needleLength) {
+        begin = (const char*) memchr(begin, needle[0], end - begin - needleLength + 1);
+        if (!begin)
+            return nullptr;
+        if (memcmp(begin + 1, needle + 1, needleLength - 1) == 0)
+            return begin;
+        ++begin;
+    }
+    return nullptr;
+}
+
+static const char *memFind(const char *begin, const char *end, const char *needle)
+{
+    return memFind(begin, end, needle, strlen(needle));
+}
+
+static void utf8Append(string &dst, uint32_t cp)
+{
+    if (cp < 0x80) {
+        dst += (char) cp;
+    }
+    else if (cp < 0x800) {
+        dst += (char) (0xc0 | (cp >> 6));
+        dst += (char) (0x80 | (cp & 0x3f));
+    }
+    else if (cp < 0x10000) {
+        dst += (char) (0xe0 | (cp >> 12));
+        dst += (char) (0x80 | ((cp >> 6) & 0x3f));
+        dst += (char) (0x80 | (cp & 0x3f));
+    }
+    else {
+        dst += (char) (0xf0 | (cp >> 18));
+        dst += (char) (0x80 | ((cp >> 12) & 0x3f));
+        dst += (char) (0x80 | ((cp >> 6) & 0x3f));
+        dst += (char) (0x80 | (cp & 0x3f));
+    }
+}
+
+/**
+ * Appends [begin, end) to dst, with HTML character references decoded as Gumbo would.
+ * Only the common named references and plain numeric ones are handled. Returns false for
+ * anything else (and for CR and NUL, which Gumbo rewrites), so that the caller can use the DOM.
+ */
+static bool htmlDecode(const char *begin, const char *end, string &dst)
+{
+    static const struct { const char *name; const char *value; } NAMED[] = {
+        {"amp;", "&"}, {"lt;", "<"}, {"gt;", ">"}, {"quot;", "\""}, {"apos;", "'"}, {"nbsp;", "\xc2\xa0"}
+    };
+
+    while (begin < end) {
+        const char *amp = (const char*) memchr(begin, '&', end - begin);
+        const char *chunkEnd = amp ? amp : end;
+        for (const char *c = begin; c < chunkEnd; ++c) {
+            if (*c == '\r' || *c == '\0')
+                return false;
+        }
+        dst.append(begin, chunkEnd);
+        if (!amp)
+            break;
+
+        const char *ref = amp + 1;
+        if (ref == end || !(std::isalnum((unsigned char) *ref) || *ref == '#')) {
+            // not a character reference
+            dst += '&';
+            begin = ref;
+            continue;
+        }
+
+        if (*ref == '#') {
+            const bool hex = (ref + 1 < end && (ref[1] == 'x' || ref[1] == 'X'));
+            const char *digits = ref + (hex ? 2 : 1);
+            const char *semicolon = digits;
+            uint32_t cp = 0;
+            while (semicolon < end && std::isxdigit((unsigned char) *semicolon) && cp <= 0x10ffff) {
+                if (!hex && !std::isdigit((unsigned char) *semicolon))
+                    return false;
+                cp = cp * (hex ? 16 : 10) + (std::isdigit((unsigned char) *semicolon)
+                                             ? *semicolon - '0' : (std::tolower(*semicolon) - 'a' + 10));
+                ++semicolon;
+            }
+            // Gumbo replaces NUL, C1 controls and surrogates, leave those to it
+            if (semicolon == digits || semicolon == end || *semicolon != ';'
+                    || cp == 0 || (cp >= 0x80 && cp <= 0x9f) || (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff)
+                return false;
+            utf8Append(dst, cp);
+            begin = semicolon + 1;
+            continue;
+        }
+
+        bool found = false;
+        for (const auto &named : NAMED) {
+            const size_t length = strlen(named.name);
+            if ((size_t) (end - ref) >= length && !memcmp(ref, named.name, length)) {
+                dst += named.value;
+                begin = ref + length;
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * For a match somewhere within a tag, returns the start of that tag ('<'), or nullptr if the match
+ * is not inside a tag
+ */
+static const char *htmlTagStart(const char *begin, const char *match)
+{
+    for (const char *c = match; c >= begin; --c) {
+        if (*c == '<')
+            return c;
+        if (*c == '>')
+            return nullptr;
+    }
+    return nullptr;
+}
+
+/**
+ * True if the tag at tagStart has the given name, e.g. "div"
+ */
+static bool htmlTagIs(const char *tagStart, const char *end, const char *name)
+{
+    const size_t length = strlen(name);
+    if ((size_t) (end - tagStart) < length + 2 || memcmp(tagStart + 1, name, length))
+        return false;
+    const char next = tagStart[1 + length];
+    return std::isspace((unsigned char) next) || next == '>' || next == '/';
+}
+
+/**
+ * Finds the start tag with the given name which contains attribute (e.g. id="name-section")
+ * in [begin, end), and returns the position right after its '>'.
+ */
+static const char *htmlFindStartTag(const char *begin, const char *end, const char *name, const char *attribute)
+{
+    const char *match = memFind(begin, end, attribute);
+    if (!match)
+        return nullptr;
+    const char *tagStart = htmlTagStart(begin, match);
+    if (!tagStart || !htmlTagIs(tagStart, end, name) || !std::isspace((unsigned char) match[-1]))
+        return nullptr;
+    const char *tagEnd = (const char*) memchr(match, '>', end - match);
+    return tagEnd ? tagEnd + 1 : nullptr;
+}
+
+/**
+ * The value of a double-quoted attribute, e.g. ' src="', within the tag that starts at tagStart
+ */
+static bool htmlAttributeValue(const char *tagStart, const char *end, const char *attribute,
+                               const char **valueBegin, const char **valueEnd)
+{
+    const char *tagEnd = (const char*) memchr(tagStart, '>', end - tagStart);
+    if (!tagEnd)
+        return false;
+    const char *match = memFind(tagStart, tagEnd, attribute);
+    if (!match)
+        return false;
+    *valueBegin = match + strlen(attribute);
+    *valueEnd = (const char*) memchr(*valueBegin, '"', end - *valueBegin);
+    return *valueEnd != nullptr;
+}
+
+/**
+ * Text of an element that starts at contentStart, if it has no child elements
+ * before the text, just as gumboFindFirstText() would find it
+ */
+static bool htmlElementText(const char *contentStart, const char *end, string &text)
+{
+    const char *textEnd = (const char*) memchr(contentStart, '<', end - contentStart);
+    if (!textEnd)
+        return false;
+    const char *c = contentStart;
+    while (c < textEnd && std::isspace((unsigned char) *c))
+        ++c;
+    if (c == textEnd)
+        return false;
+    text.clear();
+    return htmlDecode(contentStart, textEnd, text);
+}
+
 string strTrimmed(string s)
 {
     while (!s.empty() && std::isspace(s.front()))
@@ -150,14 +365,8 @@ string strJoin(const vector<string> &v, const string &joinString)
     return ret;
 }
 
-template <class T, class Cond>
-static void removeIf(std::vector<T> &vec, const Cond &cond)
-{
-    vec.erase(std::remove_if(vec.begin(), vec.end(), cond), vec.end());
-}
-
-template <class T>
-static void gumboForEach(const GumboVector &vec, const function<void(T*)> &functor)
+template <class T, class Functor>
+static void gumboForEach(const GumboVector &vec, const Functor &functor)
 {
     for (uint i = 0; i < vec.length; ++i)
         functor(reinterpret_cast<T*>(vec.data[i]));
@@ -266,257 +475,1171 @@ static void jsonPrint(const rapidjson::Value &value)
     }
 }
 
-static void jsonGatherMembers(vector<rapidjson::Document> &out, const rapidjson::Value &value, const string &memberName)
+enum JsonVisit
+{
+    JsonDescend,    // look into the member's value
+    JsonSkip,       // continue with the next member
+    JsonStop
+};
+
+/**
+ * Calls visitor(name, value) for all object members in the JSON tree, in document order,
+ * without copying anything. Returns false if the visitor stopped the walk.
+ */
+template <class Visitor>
+static bool jsonVisitMembers(const rapidjson::Value &value, Visitor &visitor)
 {
     if (value.IsObject()) {
         rapidjson::Value::ConstObject obj = value.GetObject();
         for (auto it = obj.MemberBegin(); it != obj.MemberEnd(); ++it) {
-            if (it->name.GetString() == memberName) {
-                out.push_back(rapidjson::Document());
-                out.back().CopyFrom(it->value, out.back().GetAllocator());
-            } else {
-                jsonGatherMembers(out, it->value, memberName);
-            }
+            const JsonVisit visit = visitor(it->name.GetString(), it->value);
+            if (visit == JsonStop || (visit == JsonDescend && !jsonVisitMembers(it->value, visitor)))
+                return false;
         }
     }
     else if (value.IsArray()) {
         rapidjson::Value::ConstArray array = value.GetArray();
         for (rapidjson::SizeType i = 0; i < array.Size(); ++i) {
-            jsonGatherMembers(out, array[i], memberName);
+            if (!jsonVisitMembers(array[i], visitor))
+                return false;
         }
     }
+    return true;
 }
 
-static vector<rapidjson::Document> jsonFindMembers(const rapidjson::Value &value, const string &memberName)
+static void jsonAssign(string &dst, const rapidjson::Value *value)
 {
-    vector<rapidjson::Document> ret;
-    jsonGatherMembers(ret, value, memberName);
-    return ret;
+    if (value && value->IsString())
+        dst.assign(value->GetString(), value->GetStringLength());
 }
 
-static bool gumboElementHasAttrs(const GumboVector &attrs, const string &name, const string &value)
+static constexpr bool strEquals(const char *a, const char *b)
 {
-    for (uint i = 0; i < attrs.length; ++i) {
-        GumboAttribute *attr = (GumboAttribute*) attrs.data[i];
-        if (name == attr->name && (value.empty() || value == attr->value))
+    return (*a == *b) && (*a == '\0' || strEquals(a + 1, b + 1));
+}
+
+static constexpr size_t strLength(const char *s)
+{
+    return *s ? (1 + strLength(s + 1)) : 0;
+}
+
+/**
+ * Returns true if the whitespace-separated list contains the given token, as in class="a b c"
+ */
+static bool strHasToken(const char *list, const char *token, size_t tokenLength)
+{
+    const char *pos = list;
+    while (*pos) {
+        while (*pos && std::isspace((unsigned char) *pos))
+            ++pos;
+        const char *start = pos;
+        while (*pos && !std::isspace((unsigned char) *pos))
+            ++pos;
+        if ((size_t) (pos - start) == tokenLength && memcmp(start, token, tokenLength) == 0)
             return true;
     }
     return false;
 }
 
-static string gumboGetAttributeValue(const GumboNode *node, const string &name)
+static const char *gumboAttribute(const GumboVector &attrs, const char *name)
+{
+    for (uint i = 0; i < attrs.length; ++i) {
+        const GumboAttribute *attr = (const GumboAttribute*) attrs.data[i];
+        if (!strcmp(name, attr->name))
+            return attr->value;
+    }
+    return nullptr;
+}
+
+static const char *gumboAttribute(const GumboNode *node, const char *name)
 {
     if (node->type != GUMBO_NODE_ELEMENT)
-        return string();
+        return nullptr;
+    return gumboAttribute(node->v.element.attributes, name);
+}
 
-    for (uint i = 0; i < node->v.element.attributes.length; ++i) {
-        GumboAttribute *attr = (GumboAttribute*) node->v.element.attributes.data[i];
-        if (name == attr->name)
-            return string(attr->value);
-    }
-    return string();
+static string gumboGetAttributeValue(const GumboNode *node, const char *name)
+{
+    const char *value = gumboAttribute(node, name);
+    return value ? string(value) : string();
 }
 
-using AttrList = vector<pair<string, string>>;
+/**
+ * Matches elements by tag and, optionally, a single attribute. Selectors are built once at compile
+ * time, and matched without any allocations. For class="...", the value is matched against each
+ * of the space-separated class names, otherwise the attribute value has to match exactly.
+ * If no value is given, the attribute only needs to be present.
+ */
+struct GumboSelector
+{
+    constexpr GumboSelector(GumboTag tag, const char *attrName = nullptr, const char *attrValue = nullptr)
+        : tag(tag)
+        , attrName(attrName)
+        , attrValue(attrValue)
+        , attrValueLength(attrValue ? strLength(attrValue) : 0)
+        , isClass(attrName && strEquals(attrName, "class"))
+    {
+    }
+
+    bool matches(const GumboNode *node) const
+    {
+        return node->type == GUMBO_NODE_ELEMENT && matches(node->v.element.tag, node->v.element.attributes);
+    }
+
+    bool matches(GumboTag elementTag, const GumboVector &attributes) const
+    {
+        if (elementTag != tag)
+            return false;
+        if (!attrName)
+            return true;
+
+        const char *value = gumboAttribute(attributes, attrName);
+        if (!value)
+            return false;
+        if (!attrValue)
+            return true;
+        return isClass ? strHasToken(value, attrValue, attrValueLength) : !strcmp(value, attrValue);
+    }
+
+    GumboTag tag;
+    const char *attrName;
+    const char *attrValue;
+    size_t attrValueLength;
+    bool isClass;
+};
+
+enum GumboVisit { GumboDescend, GumboSkipChildren, GumboStop };
 
-static void gumboGather(vector<GumboNode*> &out, GumboNode *node, GumboTag tag, const AttrList &attrs, bool recursive)
+static GumboNode *gumboChild(const GumboNode *node, size_t index)
 {
-    if (node->type != GUMBO_NODE_ELEMENT)
-        return;
+    const GumboVector *children = nullptr;
+    if (node->type == GUMBO_NODE_ELEMENT || node->type == GUMBO_NODE_TEMPLATE)
+        children = &node->v.element.children;
+    else if (node->type == GUMBO_NODE_DOCUMENT)
+        children = &node->v.document.children;
+    return (children && index < children->length) ? (GumboNode*) children->data[index] : nullptr;
+}
 
-    if (node->v.element.tag == tag) {
-        bool allAttrsMatch = true;
-        for (const auto &attr : attrs) {
-            if (!gumboElementHasAttrs(node->v.element.attributes, attr.first, attr.second)) {
-                allAttrsMatch = false;
-                break;
-            }
-        }
+/**
+ * Iterative pre-order traversal of root and its subtree. Uses the parent links in the tree instead
+ * of a stack, so there's no recursion and no allocation. The visitor decides whether to descend
+ * into a node, skip its children, or stop the traversal altogether. leave() is called for each
+ * visited node once its subtree is done.
+ */
+template <class Visitor, class LeaveFunctor>
+static void gumboTraverse(GumboNode *root, const Visitor &visitor, const LeaveFunctor &leave)
+{
+    GumboNode *node = root;
+    while (node) {
+        const GumboVisit visit = visitor(node);
+        if (visit == GumboStop)
+            return;
 
-        if (allAttrsMatch) {
-            out.push_back(node);
-            if (!recursive)
-                return;
+        GumboNode *next = (visit == GumboDescend) ? gumboChild(node, 0) : nullptr;
+        if (!next)
+            leave(node);
+        while (!next && node != root) {
+            next = gumboChild(node->parent, node->index_within_parent + 1);
+            node = node->parent;
+            if (!next)
+                leave(node);
         }
+        node = next;
     }
+}
 
-    gumboForEach<GumboNode>(node->v.element.children, [&](GumboNode *child) {
-        gumboGather(out, child, tag, attrs, recursive);
+template <class Visitor>
+static void gumboTraverse(GumboNode *root, const Visitor &visitor)
+{
+    gumboTraverse(root, visitor, [](GumboNode*) {});
+}
+
+/**
+ * Feeds the subtree below root to an event-based visitor, which implements
+ *      void startElement(GumboTag tag, const GumboVector &attributes);
+ *      void endElement();
+ *      void text(const char *text);
+ *      bool done() const;
+ * The traversal ends as soon as done() returns true.
+ */
+template <class Visitor>
+static void gumboVisit(GumboNode *root, Visitor &visitor)
+{
+    gumboTraverse(root, [&](GumboNode *node) {
+        if (node->type == GUMBO_NODE_ELEMENT)
+            visitor.startElement(node->v.element.tag, node->v.element.attributes);
+        else if (node->type == GUMBO_NODE_TEXT)
+            visitor.text(node->v.text.text);
+        if (visitor.done())
+            return GumboStop;
+        return (node->type == GUMBO_NODE_ELEMENT) ? GumboDescend : GumboSkipChildren;
+    }, [&](GumboNode *node) {
+        if (node->type == GUMBO_NODE_ELEMENT)
+            visitor.endElement();
     });
 }
 
-static vector<GumboNode*> gumboFind(GumboNode *node, GumboTag tag, const AttrList &attrs = {}, bool recursive = false)
+/**
+ * Calls functor for each element matching the selector. If recursive is false,
+ * matching elements are not searched for further matches.
+ */
+template <class Functor>
+static void gumboForEachMatch(GumboNode *node, const GumboSelector &selector, bool recursive, const Functor &functor)
 {
-    vector<GumboNode*> ret;
-    gumboGather(ret, node, tag, attrs, recursive);
-    return ret;
+    gumboTraverse(node, [&](GumboNode *current) {
+        if (current->type != GUMBO_NODE_ELEMENT)
+            return GumboSkipChildren;
+        if (!selector.matches(current))
+            return GumboDescend;
+        functor(current);
+        return recursive ? GumboDescend : GumboSkipChildren;
+    });
 }
 
-static GumboNode* gumboFindFirst(GumboNode *node, GumboTag tag, const AttrList &attrs = {})
+#ifdef MUSICSCRAPE_TOKENIZER_BACKEND
+
+static bool htmlIsVoidElement(GumboTag tag)
 {
-    const vector<GumboNode*> ret = gumboFind(node, tag, attrs, false);
-    return ret.empty() ? nullptr : ret.front();
+    switch (tag) {
+    case GUMBO_TAG_AREA: case GUMBO_TAG_BASE: case GUMBO_TAG_BR: case GUMBO_TAG_COL: case GUMBO_TAG_EMBED:
+    case GUMBO_TAG_HR: case GUMBO_TAG_IMG: case GUMBO_TAG_INPUT: case GUMBO_TAG_KEYGEN: case GUMBO_TAG_LINK:
+    case GUMBO_TAG_META: case GUMBO_TAG_PARAM: case GUMBO_TAG_SOURCE: case GUMBO_TAG_TRACK: case GUMBO_TAG_WBR:
+        return true;
+    default:
+        return false;
+    }
 }
 
-const static char* gumboFindFirstText(GumboNode *node, const char *defaultValue = nullptr)
+/**
+ * The most common end tags that HTML allows to be omitted: true if a start tag
+ * implicitly closes the open element
+ */
+static bool htmlImpliesEndTag(GumboTag open, GumboTag start)
 {
-    if (node->type == GUMBO_NODE_ELEMENT) {
-        for (uint i = 0; i < node->v.element.children.length; ++i) {
-            const char *text = gumboFindFirstText((GumboNode*) node->v.element.children.data[i]);
-            if (text)
-                return text;
+    switch (open) {
+    case GUMBO_TAG_LI:
+        return start == GUMBO_TAG_LI;
+    case GUMBO_TAG_DT: case GUMBO_TAG_DD:
+        return start == GUMBO_TAG_DT || start == GUMBO_TAG_DD;
+    case GUMBO_TAG_OPTION:
+        return start == GUMBO_TAG_OPTION;
+    case GUMBO_TAG_TD: case GUMBO_TAG_TH:
+        return start == GUMBO_TAG_TD || start == GUMBO_TAG_TH || start == GUMBO_TAG_TR;
+    case GUMBO_TAG_TR:
+        return start == GUMBO_TAG_TR;
+    case GUMBO_TAG_P:
+        switch (start) {
+        case GUMBO_TAG_P: case GUMBO_TAG_DIV: case GUMBO_TAG_UL: case GUMBO_TAG_TABLE:
+        case GUMBO_TAG_H1: case GUMBO_TAG_H2: case GUMBO_TAG_H3: case GUMBO_TAG_H4: case GUMBO_TAG_H5: case GUMBO_TAG_H6:
+            return true;
+        default:
+            return false;
         }
-        return defaultValue;
-    }
-    else if (node->type == GUMBO_NODE_TEXT) {
-        return node->v.text.text;
+    default:
+        return false;
     }
-    else {
-        return defaultValue;
+}
+
+/**
+ * Streaming alternative to gumboVisit(), which runs Gumbo's tokenizer without its tree construction,
+ * and feeds the same events to the visitor. Open elements are tracked on a small stack, so that
+ * void elements, omitted end tags and stray end tags still produce balanced events. Tokens are
+ * allocated with the allocator of gumboOptions, and freed as soon as they have been visited.
+ *
+ * Unlike the tree construction, the tag stack doesn't repair misnested markup. The traversal
+ * ends as soon as the visitor's done() returns true.
+ */
+template <class Visitor>
+static void tokenizerVisit(const char *html, size_t length, const GumboOptions &gumboOptions, Visitor &visitor)
+{
+    // gumbo_add_error() gives up before touching the empty error list if max_errors is 0
+    GumboOptions options = gumboOptions;
+    options.max_errors = 0;
+    GumboOutput output;
+    memset(&output, 0, sizeof(output));
+    GumboParser parser;
+    memset(&parser, 0, sizeof(parser));
+    parser._options = &options;
+    parser._output = &output;
+    gumbo_tokenizer_state_init(&parser, html, length);
+
+    vector<GumboTag> openElements;
+    string text;
+    bool isWhitespace = true;
+
+    // whitespace-only runs are not text nodes in the tree, and not passed on to the visitor
+    const auto flushText = [&]() {
+        if (!text.empty() && !isWhitespace)
+            visitor.text(text.c_str());
+        text.clear();
+        isWhitespace = true;
+    };
+    const auto closeElements = [&](size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            openElements.pop_back();
+            visitor.endElement();
+        }
+    };
+
+    GumboToken token;
+    bool eof = false;
+    while (!eof && !visitor.done()) {
+        gumbo_lex(&parser, &token);
+        switch (token.type) {
+        case GUMBO_TOKEN_CHARACTER:
+        case GUMBO_TOKEN_CDATA:
+            isWhitespace = false;
+            utf8Append(text, (uint32_t) token.v.character);
+            break;
+        case GUMBO_TOKEN_WHITESPACE:
+            utf8Append(text, (uint32_t) token.v.character);
+            break;
+        case GUMBO_TOKEN_START_TAG: {
+            flushText();
+            const GumboTag tag = token.v.start_tag.tag;
+            while (!openElements.empty() && htmlImpliesEndTag(openElements.back(), tag))
+                closeElements(1);
+
+            visitor.startElement(tag, token.v.start_tag.attributes);
+            if (htmlIsVoidElement(tag) || token.v.start_tag.is_self_closing)
+                visitor.endElement();
+            else
+                openElements.push_back(tag);
+
+            // the tree construction switches the tokenizer into the right state for raw text content
+            if (tag == GUMBO_TAG_SCRIPT)
+                gumbo_tokenizer_set_state(&parser, GUMBO_LEX_SCRIPT);
+            else if (tag == GUMBO_TAG_STYLE || tag == GUMBO_TAG_XMP || tag == GUMBO_TAG_IFRAME
+                     || tag == GUMBO_TAG_NOEMBED || tag == GUMBO_TAG_NOFRAMES)
+                gumbo_tokenizer_set_state(&parser, GUMBO_LEX_RAWTEXT);
+            else if (tag == GUMBO_TAG_TITLE || tag == GUMBO_TAG_TEXTAREA)
+                gumbo_tokenizer_set_state(&parser, GUMBO_LEX_RCDATA);
+            else if (tag == GUMBO_TAG_PLAINTEXT)
+                gumbo_tokenizer_set_state(&parser, GUMBO_LEX_PLAINTEXT);
+            break;
+        }
+        case GUMBO_TOKEN_END_TAG: {
+            flushText();
+            const auto it = std::find(openElements.rbegin(), openElements.rend(), token.v.end_tag);
+            if (it != openElements.rend())
+                closeElements(it - openElements.rbegin() + 1);
+            break;
+        }
+        case GUMBO_TOKEN_NULL:
+            // dropped by the tree construction as well
+            break;
+        case GUMBO_TOKEN_EOF:
+            flushText();
+            closeElements(openElements.size());
+            eof = true;
+            break;
+        default:
+            // comments, doctype and NUL characters
+            flushText();
+            break;
+        }
+        gumbo_token_destroy(&parser, &token);
     }
+
+    gumbo_tokenizer_state_destroy(&parser);
 }
 
-namespace ScrapeBandcamp {
+#endif // MUSICSCRAPE_TOKENIZER_BACKEND
 
-string searchUrl(const string &pattern)
+static vector<GumboNode*> gumboFind(GumboNode *node, const GumboSelector &selector, bool recursive = false)
 {
-    return string("https://bandcamp.com/search?q=") + percentEncode(pattern);
+    vector<GumboNode*> ret;
+    gumboForEachMatch(node, selector, recursive, [&](GumboNode *match) { ret.push_back(match); });
+    return ret;
 }
 
-vector<Result> searchResult(const std::string &html)
+static GumboNode* gumboFindFirst(GumboNode *node, const GumboSelector &selector)
 {
-    vector<Result> ret;
-    GumboOutput* output = gumbo_parse(html.data());
+    GumboNode *ret = nullptr;
+    gumboTraverse(node, [&](GumboNode *current) {
+        if (current->type != GUMBO_NODE_ELEMENT)
+            return GumboSkipChildren;
+        if (!selector.matches(current))
+            return GumboDescend;
+        ret = current;
+        return GumboStop;
+    });
+    return ret;
+}
 
-    GumboNode* resultItem = gumboFindFirst(output->root, GUMBO_TAG_UL, {{"class", "result-items"}});
-    if (!resultItem) {
-        SCRAPE_LOG() << "No <ul class='result-items'> found in HTML";
-        goto out;
+/**
+ * Bump-pointer allocator for Gumbo. Individual frees are no-ops, all memory is recycled at once
+ * by reset(), which keeps the blocks around for the next page. Aborts when a block can't be
+ * allocated.
+ */
+class ScrapeArena
+{
+public:
+    ScrapeArena()
+        : m_used(0)
+        , m_allocations(0)
+        , m_heapAllocations(0)
+    {
     }
 
-    gumboForEach<GumboNode>(resultItem->v.element.children, [&](GumboNode *resultNode) {
-        if (resultNode->type != GUMBO_NODE_ELEMENT || resultNode->v.element.tag != GUMBO_TAG_LI)
-            return;
+    ~ScrapeArena()
+    {
+        release();
+    }
 
-        string className = gumboGetAttributeValue(resultNode, "class");
-        const char *classNamePrefix = "searchresult ";
-        if (!strStartsWith(className, classNamePrefix))
-            return;
-        className = className.substr(strlen(classNamePrefix));
+    void *allocate(size_t size)
+    {
+        size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        if (m_blocks.empty() || m_used + size > m_blocks.back().size)
+            addBlock(size);
 
-        #define RETURN_IF(expression, log) if (expression) { SCRAPE_LOG() << log; return; }
+        void *ret = m_blocks.back().data + m_used;
+        m_used += size;
+        m_allocations++;
+        return ret;
+    }
 
-        RETURN_IF((className != "band") && (className != "album") && (className != "track"),
-                  string("Invalid class name: ") + className);
+    void reset()
+    {
+        // merge all blocks into one, so that the next page of the same size fits into a single block
+        if (m_blocks.size() > 1) {
+            const size_t total = capacity();
+            release();
+            addBlock(total);
+        }
+        m_used = 0;
+    }
 
-        GumboNode* resultInfo = gumboFindFirst(resultNode, GUMBO_TAG_DIV, {{"class", "result-info"}});
-        RETURN_IF(!resultInfo, "No <ul class='result-info'> found for result-items node");
+    void release()
+    {
+        for (const Block &block : m_blocks)
+            free(block.data);
+        m_blocks.clear();
+        m_used = 0;
+    }
 
-        GumboNode *itemUrlNode = gumboFindFirst(resultInfo, GUMBO_TAG_DIV, {{"class", "itemurl"}});
-        RETURN_IF(!itemUrlNode, "No <div class='itemurl'> found for result-info node");
-        const char *itemUrl = gumboFindFirstText(itemUrlNode);
-        RETURN_IF(!itemUrl, "No text in <div class='itemurl'>");
+    size_t capacity() const
+    {
+        size_t ret = 0;
+        for (const Block &block : m_blocks)
+            ret += block.size;
+        return ret;
+    }
 
-        GumboNode *headingNode = gumboFindFirst(resultInfo, GUMBO_TAG_DIV, {{"class", "heading"}});
-        RETURN_IF(!headingNode, "No <div class='heading'> found for result-info node");
-        const char *heading = gumboFindFirstText(headingNode);
-        RETURN_IF(!heading, "No text in <div class='heading'>");
+    size_t allocations() const { return m_allocations; }
+    size_t heapAllocations() const { return m_heapAllocations; }
 
-        GumboNode *artNode = gumboFindFirst(resultNode, GUMBO_TAG_DIV, {{"class", "art"}});
-        RETURN_IF(!artNode, "No <div class='art'> found for result-info node");
-        GumboNode *artImgNode = gumboFindFirst(artNode, GUMBO_TAG_IMG);
-        RETURN_IF(!artImgNode, "No <img> found for art node");
-        const string artSrc = gumboGetAttributeValue(artImgNode, "src");
-        RETURN_IF(artSrc.empty(), "No valid src= value in img node");
+    static void *gumboAllocate(void *userdata, size_t size)
+    {
+        return static_cast<ScrapeArena*>(userdata)->allocate(size);
+    }
 
-        GumboNode *subheadingNode = gumboFindFirst(resultInfo, GUMBO_TAG_DIV, {{"class", "subhead"}});
-        const string subhead(subheadingNode ? gumboFindFirstText(subheadingNode, "") : "");
+    static void gumboDeallocate(void *, void *)
+    {
+    }
 
-        Result result;
-        result.url = strTrimmed(itemUrl);
-        result.artUrl = artSrc;
-        result.trackNum = -1;
-        result.mp3duration = -1;
-        if (className == "band") {
-            result.resultType = Result::Band;
-            result.bandName = strTrimmed(heading);
+private:
+    static const size_t ALIGNMENT = 16;
+    static const size_t MIN_BLOCK_SIZE = 64 * 1024;
+
+    struct Block
+    {
+        char *data;
+        size_t size;
+    };
+
+    void addBlock(size_t minSize)
+    {
+        const size_t lastSize = m_blocks.empty() ? 0 : m_blocks.back().size;
+        const size_t size = std::max(std::max(minSize, 2 * lastSize), MIN_BLOCK_SIZE);
+        char *data = (char*) malloc(size);
+        if (!data) {
+            // Gumbo is C and can't unwind an exception, nor does it check the allocator's result
+            SCRAPE_LOG() << "Failed to allocate " << size << " bytes for the parser arena";
+            std::abort();
         }
-        else if (className == "album") {
-            result.resultType = Result::Album;
-            result.albumName = strTrimmed(heading);
+        m_blocks.push_back(Block{data, size});
+        m_used = 0;
+        m_heapAllocations++;
+    }
 
-            RETURN_IF(subhead.empty(), "Invalid subhead node");
-            const vector<string> parts = strSplit(subhead, "by");
-            RETURN_IF(parts.size() != 2, "Invalid subhead node text");
-            result.bandName = strTrimmed(parts[1]);
+    vector<Block> m_blocks;
+    size_t m_used;
+    size_t m_allocations;
+    size_t m_heapAllocations;
+};
+
+const size_t ScrapeArena::ALIGNMENT;
+const size_t ScrapeArena::MIN_BLOCK_SIZE;
+
+/**
+ * Adds the time from construction until stop() or destruction to one of the ScrapeStats counters.
+ * Doesn't read the clock at all if stats is null.
+ */
+class ScrapeTimer
+{
+public:
+    ScrapeTimer(ScrapeStats *stats, uint64_t ScrapeStats::*counter)
+        : m_stats(stats)
+        , m_counter(counter)
+    {
+        if (m_stats)
+            m_start = std::chrono::steady_clock::now();
+    }
+
+    ~ScrapeTimer()
+    {
+        stop();
+    }
+
+    void stop()
+    {
+        if (m_stats) {
+            const auto elapsed = std::chrono::steady_clock::now() - m_start;
+            m_stats->*m_counter += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            m_stats = nullptr;
         }
-        else if (className == "track") {
-            result.resultType = Result::Track;
-            result.trackName = strTrimmed(heading);
+    }
 
-            RETURN_IF(subhead.empty(), "Invalid subhead node");
-            const vector<string> fromParts = strSplit(subhead, "from");
-            const vector<string> byParts = strSplit(fromParts.back(), "by");
-            RETURN_IF(byParts.size() != 2, "Invalid subhead node text");
-            result.bandName = strTrimmed(byParts[1]);
-            if (fromParts.size() == 1)
-                result.albumName = strTrimmed(byParts[0]);
+private:
+    ScrapeStats *m_stats;
+    uint64_t ScrapeStats::*m_counter;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+struct ScrapeParserPrivate
+{
+    ScrapeParserPrivate()
+        : gumboOptions(kGumboDefaultOptions)
+        , collectStats(false)
+        , stats()
+    {
+        gumboOptions.allocator = &ScrapeArena::gumboAllocate;
+        gumboOptions.deallocator = &ScrapeArena::gumboDeallocate;
+        gumboOptions.userdata = &arena;
+        gumboOptions.max_errors = 0;
+    }
+
+    /**
+     * Resets the parser's stats for a new call. Returns null if no stats are to be collected.
+     */
+    static ScrapeStats *beginStats(ScrapeParser *parser, size_t length)
+    {
+        if (!parser || !parser->d->collectStats)
+            return nullptr;
+        ScrapeStats *stats = &parser->d->stats;
+        *stats = ScrapeStats();
+        stats->inputBytes = length;
+        return stats;
+    }
+
+    static const ScrapeOptions &optionsFor(ScrapeParser *parser)
+    {
+        static const ScrapeOptions DEFAULT_OPTIONS;
+        return parser ? parser->d->options : DEFAULT_OPTIONS;
+    }
+
+#ifdef MUSICSCRAPE_TOKENIZER_BACKEND
+    /**
+     * Runs tokenizerVisit() with the parser's arena, which is reset afterwards
+     */
+    template <class Visitor>
+    static void tokenize(ScrapeParser *parser, const char *html, size_t length, Visitor &visitor)
+    {
+        tokenizerVisit(html, length, parser ? parser->d->gumboOptions : kGumboDefaultOptions, visitor);
+        if (parser)
+            parser->d->arena.reset();
+    }
+#endif
+
+    static GumboOutput *parse(ScrapeParser *parser, const char *html, size_t length, ScrapeStats *stats = nullptr)
+    {
+        const GumboOptions *options = parser ? &parser->d->gumboOptions : &kGumboDefaultOptions;
+        ScrapeTimer timer(stats, &ScrapeStats::htmlParseNs);
+        GumboOutput *output = gumbo_parse_with_options(options, html, length);
+        timer.stop();
+
+        if (stats) {
+            gumboTraverse(output->document, [&](GumboNode*) {
+                stats->nodeCount++;
+                return GumboDescend;
+            });
         }
+        return output;
+    }
 
-        ret.push_back(result);
+    /**
+     * Buffers for in-situ JSON parsing: the JSON text, which the parsed strings point into,
+     * and the memory for the Document's values. Both keep their size across calls.
+     */
+    struct JsonBuffers
+    {
+        string text;
+        vector<char> pool;
+    };
+
+    static JsonBuffers &jsonBuffers(ScrapeParser *parser, JsonBuffers &fallback)
+    {
+        return parser ? parser->d->json : fallback;
+    }
 
-        #undef RETURN_IF
-    });
+    static void destroy(ScrapeParser *parser, GumboOutput *output)
+    {
+        // with the arena, there's no need to walk the tree and free every node
+        if (parser)
+            parser->d->arena.reset();
+        else
+            gumbo_destroy_output(&kGumboDefaultOptions, output);
+    }
 
-out:
-    gumbo_destroy_output(&kGumboDefaultOptions, output);
-    return ret;
+    ScrapeArena arena;
+    GumboOptions gumboOptions;
+    ScrapeOptions options;
+    JsonBuffers json;
+    bool collectStats;
+    ScrapeStats stats;
+};
+
+ScrapeParser::ScrapeParser()
+    : d(new ScrapeParserPrivate())
+{
 }
 
-std::string bandInfoUrl(const std::string &bandUrl)
+ScrapeParser::~ScrapeParser()
 {
-    return bandUrl + "/music";
+    delete d;
 }
 
-static ResultList albumInfo(const std::string &html, GumboNode *root)
+void ScrapeParser::setMaxErrors(int maxErrors)
 {
-    ResultList ret;
+    d->gumboOptions.max_errors = maxErrors;
+}
 
-    #define RETURN_IF(expression, log) if (expression) { SCRAPE_LOG() << log; return ret; }
+int ScrapeParser::maxErrors() const
+{
+    return d->gumboOptions.max_errors;
+}
 
-    // get band name and track/album title
-    GumboNode *bandNode = gumboFindFirst(root, GUMBO_TAG_DIV, {{"id", "name-section"}});
-    RETURN_IF(!bandNode, "No <div id='name-section'> node");
-    GumboNode *titleNode = gumboFindFirst(bandNode, GUMBO_TAG_H2, {{"class", "trackTitle"}});
-    RETURN_IF(!titleNode, "No <h2 class='trackTitle'> node");
-    const char *title = gumboFindFirstText(titleNode);
-    RETURN_IF(!title, "No text in <h2 class='trackTitle'> node");
-    GumboNode *artistNode = gumboFindFirst(bandNode, GUMBO_TAG_A);
-    RETURN_IF(!artistNode, "No artist <a> node");
-    const char *artist = gumboFindFirstText(artistNode);
-    RETURN_IF(!artist, "No artist <a> node text");
+size_t ScrapeParser::arenaCapacity() const
+{
+    return d->arena.capacity();
+}
 
-    // get album art
-    GumboNode *albumArtNode = gumboFindFirst(root, GUMBO_TAG_DIV, {{"id", "tralbumArt"}});
-    RETURN_IF(!albumArtNode, "No <div id='tralbumArt'> node");
-    GumboNode *albumArtImg = gumboFindFirst(albumArtNode, GUMBO_TAG_IMG);
-    RETURN_IF(!albumArtImg, "No <img> in <div id='tralbumArt'> node");
-    const string albumArtSrc = gumboGetAttributeValue(albumArtImg, "src");
-    RETURN_IF(albumArtSrc.empty(), "Empty <img> in <div id='tralbumArt'> node");
-
-    // Look for tralbum JSON
-    vector<GumboNode*> scriptElems = gumboFind(root, GUMBO_TAG_SCRIPT);
-    removeIf(scriptElems, [](GumboNode *node) {
-        return gumboGetAttributeValue(node, "data-tralbum").empty();
-    });
-    RETURN_IF(scriptElems.size() != 1, "Could'nt find tralbum script element");
+size_t ScrapeParser::arenaAllocations() const
+{
+    return d->arena.allocations();
+}
 
-    // Parse JSON
-    const string tracksJsonStr = gumboGetAttributeValue(scriptElems[0], "data-tralbum");
-    rapidjson::Document tracksJson;
-    tracksJson.Parse(tracksJsonStr.data());
-    RETURN_IF(tracksJson.HasParseError(), "Error while parsing Trackinfo JSON");
-    RETURN_IF(!tracksJson.HasMember("trackinfo"), "Malformed tralbum data");
+size_t ScrapeParser::heapAllocations() const
+{
+    return d->arena.heapAllocations();
+}
+
+void ScrapeParser::releaseMemory()
+{
+    d->arena.release();
+}
+
+void ScrapeParser::setOptions(const ScrapeOptions &options)
+{
+    d->options = options;
+}
+
+const ScrapeOptions &ScrapeParser::options() const
+{
+    return d->options;
+}
+
+void ScrapeParser::setCollectStats(bool enabled)
+{
+    d->collectStats = enabled;
+    if (!enabled)
+        d->stats = ScrapeStats();
+}
+
+bool ScrapeParser::collectStats() const
+{
+    return d->collectStats;
+}
+
+const ScrapeStats &ScrapeParser::stats() const
+{
+    return d->stats;
+}
+
+const static char* gumboFindFirstText(GumboNode *node, const char *defaultValue = nullptr)
+{
+    if (node->type == GUMBO_NODE_ELEMENT) {
+        for (uint i = 0; i < node->v.element.children.length; ++i) {
+            const char *text = gumboFindFirstText((GumboNode*) node->v.element.children.data[i]);
+            if (text)
+                return text;
+        }
+        return defaultValue;
+    }
+    else if (node->type == GUMBO_NODE_TEXT) {
+        return node->v.text.text;
+    }
+    else {
+        return defaultValue;
+    }
+}
+
+namespace ScrapeBandcamp {
+
+static constexpr GumboSelector RESULT_ITEMS(GUMBO_TAG_UL, "class", "result-items");
+static constexpr GumboSelector RESULT_INFO(GUMBO_TAG_DIV, "class", "result-info");
+static constexpr GumboSelector ITEM_URL(GUMBO_TAG_DIV, "class", "itemurl");
+static constexpr GumboSelector HEADING(GUMBO_TAG_DIV, "class", "heading");
+static constexpr GumboSelector SUBHEAD(GUMBO_TAG_DIV, "class", "subhead");
+static constexpr GumboSelector ART(GUMBO_TAG_DIV, "class", "art");
+static constexpr GumboSelector IMG(GUMBO_TAG_IMG);
+static constexpr GumboSelector ANCHOR(GUMBO_TAG_A);
+static constexpr GumboSelector NAME_SECTION(GUMBO_TAG_DIV, "id", "name-section");
+static constexpr GumboSelector TRACK_TITLE(GUMBO_TAG_H2, "class", "trackTitle");
+static constexpr GumboSelector TRALBUM_ART(GUMBO_TAG_DIV, "id", "tralbumArt");
+static constexpr GumboSelector TRALBUM_SCRIPT(GUMBO_TAG_SCRIPT, "data-tralbum");
+static constexpr GumboSelector BAND_NAME_LOCATION(GUMBO_TAG_P, "id", "band-name-location");
+static constexpr GumboSelector SPAN_TITLE(GUMBO_TAG_SPAN, "class", "title");
+static constexpr GumboSelector P_TITLE(GUMBO_TAG_P, "class", "title");
+static constexpr GumboSelector PAGER(GUMBO_TAG_DIV, "class", "pager");
+static constexpr GumboSelector NEXT_PAGE(GUMBO_TAG_A, "class", "next");
+
+// initial size of the memory pool for the tralbum JSON, which grows to the largest album seen
+static const size_t JSON_POOL_MIN_SIZE = 16 * 1024;
+
+string searchUrl(const string &pattern, SearchItemType itemType, int page)
+{
+    string ret = string("https://bandcamp.com/search?q=") + percentEncode(pattern);
+    switch (itemType) {
+    case BandItems:
+        ret += "&item_type=b";
+        break;
+    case AlbumItems:
+        ret += "&item_type=a";
+        break;
+    case TrackItems:
+        ret += "&item_type=t";
+        break;
+    default:
+        // AllItems, and values that are out of range
+        break;
+    }
+    if (page > 1)
+        ret += "&page=" + std::to_string(page);
+    return ret;
+}
+
+/**
+ * Collects all fields of a single <li class='searchresult ...'> element in one pass.
+ * Each field holds the first matching element, and the first text found within it,
+ * just as gumboFindFirst() and gumboFindFirstText() would return.
+ */
+class SearchResultVisitor
+{
+public:
+    struct Field
+    {
+        bool found;
+        bool hasText;
+        int depth;          // > 0 while the element is open
+        string text;
+    };
+
+    Field resultInfo;
+    Field itemUrl;
+    Field heading;
+    Field subhead;
+    Field art;
+    Field artImg;           // text holds the src= attribute
+
+    SearchResultVisitor(const ScrapeOptions &options)
+        : m_wantUrl(options.hasField(FieldUrl))
+        , m_wantText(options.hasField(FieldTitle) || options.hasField(FieldBandName))
+        , m_wantArt(options.hasField(FieldArtUrl))
+        , m_depth(0)
+    {
+    }
+
+    void reset()
+    {
+        m_depth = 0;
+        for (Field *field : fields()) {
+            field->found = false;
+            field->hasText = false;
+            field->depth = 0;
+            field->text.clear();
+        }
+    }
+
+    void startElement(GumboTag tag, const GumboVector &attributes)
+    {
+        ++m_depth;
+
+        if (!resultInfo.found && RESULT_INFO.matches(tag, attributes))
+            open(resultInfo);
+        if (resultInfo.depth > 0) {
+            if (m_wantUrl && !itemUrl.found && ITEM_URL.matches(tag, attributes))
+                open(itemUrl);
+            if (m_wantText && !heading.found && HEADING.matches(tag, attributes))
+                open(heading);
+            if (m_wantText && !subhead.found && SUBHEAD.matches(tag, attributes))
+                open(subhead);
+        }
+
+        if (m_wantArt && !art.found && ART.matches(tag, attributes))
+            open(art);
+        if (art.depth > 0 && !artImg.found && IMG.matches(tag, attributes)) {
+            open(artImg);
+            const char *src = gumboAttribute(attributes, "src");
+            artImg.text = src ? src : "";
+        }
+    }
+
+    void endElement()
+    {
+        for (Field *field : fields()) {
+            if (field->depth == m_depth)
+                field->depth = 0;
+        }
+        --m_depth;
+    }
+
+    void text(const char *text)
+    {
+        for (Field *field : {&itemUrl, &heading, &subhead}) {
+            if (field->depth > 0 && !field->hasText) {
+                field->text = text;
+                field->hasText = true;
+            }
+        }
+    }
+
+    bool done() const
+    {
+        return resultInfo.found
+                && (!m_wantUrl || itemUrl.hasText)
+                && (!m_wantText || (heading.hasText && subhead.hasText))
+                && (!m_wantArt || artImg.found);
+    }
+
+    bool wantUrl() const { return m_wantUrl; }
+    bool wantText() const { return m_wantText; }
+    bool wantArt() const { return m_wantArt; }
+
+private:
+    array<Field*, 6> fields()
+    {
+        return {{&resultInfo, &itemUrl, &heading, &subhead, &art, &artImg}};
+    }
+
+    void open(Field &field)
+    {
+        field.found = true;
+        field.depth = m_depth;
+    }
+
+    bool m_wantUrl;
+    bool m_wantText;        // heading and subhead, which hold all names
+    bool m_wantArt;
+    int m_depth;
+};
+
+/**
+ * Checks the fields that the visitor collected for one <li class='searchresult ...'> element,
+ * and appends the Result. className is the part after "searchresult ".
+ */
+static void addSearchResult(vector<Result> &ret, const char *className, const SearchResultVisitor &visitor,
+                            const ScrapeOptions &options, ScrapeStats *stats)
+{
+    #define RETURN_IF(expression, log) if (expression) { SCRAPE_LOG() << log; if (stats) stats->skippedItems++; return; }
+
+    const bool isBand = !strcmp(className, "band");
+    const bool isAlbum = !strcmp(className, "album");
+    const bool isTrack = !strcmp(className, "track");
+    RETURN_IF(!isBand && !isAlbum && !isTrack, string("Invalid class name: ") + className);
+
+    RETURN_IF(!visitor.resultInfo.found, "No <ul class='result-info'> found for result-items node");
+    if (visitor.wantUrl()) {
+        RETURN_IF(!visitor.itemUrl.found, "No <div class='itemurl'> found for result-info node");
+        RETURN_IF(!visitor.itemUrl.hasText, "No text in <div class='itemurl'>");
+    }
+    if (visitor.wantText()) {
+        RETURN_IF(!visitor.heading.found, "No <div class='heading'> found for result-info node");
+        RETURN_IF(!visitor.heading.hasText, "No text in <div class='heading'>");
+    }
+    if (visitor.wantArt()) {
+        RETURN_IF(!visitor.art.found, "No <div class='art'> found for result-info node");
+        RETURN_IF(!visitor.artImg.found, "No <img> found for art node");
+        RETURN_IF(visitor.artImg.text.empty(), "No valid src= value in img node");
+    }
+
+    ScrapeTimer assemblyTimer(stats, &ScrapeStats::assemblyNs);
+    const string &heading = visitor.heading.text;
+    const string &subhead = visitor.subhead.text;
+    const bool wantTitle = options.hasField(FieldTitle);
+    const bool wantBandName = options.hasField(FieldBandName);
+
+    Result result;
+    if (visitor.wantUrl())
+        result.url = strTrimmed(visitor.itemUrl.text);
+    if (visitor.wantArt())
+        result.artUrl = visitor.artImg.text;
+    result.trackNum = -1;
+    result.mp3duration = -1;
+    if (isBand) {
+        result.resultType = Result::Band;
+        if (wantBandName)
+            result.bandName = strTrimmed(heading);
+    }
+    else if (isAlbum) {
+        result.resultType = Result::Album;
+        if (wantTitle)
+            result.albumName = strTrimmed(heading);
+
+        if (wantBandName) {
+            RETURN_IF(subhead.empty(), "Invalid subhead node");
+            const vector<string> parts = strSplit(subhead, "by");
+            RETURN_IF(parts.size() != 2, "Invalid subhead node text");
+            result.bandName = strTrimmed(parts[1]);
+        }
+    }
+    else if (isTrack) {
+        result.resultType = Result::Track;
+        if (wantTitle)
+            result.trackName = strTrimmed(heading);
+
+        if (wantBandName || wantTitle) {
+            RETURN_IF(subhead.empty(), "Invalid subhead node");
+            const vector<string> fromParts = strSplit(subhead, "from");
+            const vector<string> byParts = strSplit(fromParts.back(), "by");
+            RETURN_IF(byParts.size() != 2, "Invalid subhead node text");
+            if (wantBandName)
+                result.bandName = strTrimmed(byParts[1]);
+            if (wantTitle && fromParts.size() == 1)
+                result.albumName = strTrimmed(byParts[0]);
+        }
+    }
+
+    ret.push_back(result);
+
+    #undef RETURN_IF
+}
+
+static const char *SEARCH_RESULT_CLASS_PREFIX = "searchresult ";
+
+/**
+ * Runs a SearchResultVisitor for each <li> child of <ul class='result-items'>,
+ * for the tokenizer backend. With wantPager, it goes on to the <div class='pager'>
+ * after the list, and looks for the link to the next page.
+ */
+class SearchPageVisitor
+{
+public:
+    SearchPageVisitor(vector<Result> &results, const ScrapeOptions &options, ScrapeStats *stats, bool wantPager)
+        : foundList(false)
+        , foundNextPage(false)
+        , m_results(results)
+        , m_options(options)
+        , m_stats(stats)
+        , m_item(options)
+        , m_wantPager(wantPager)
+        , m_pagerDone(false)
+        , m_depth(0)
+        , m_listDepth(0)
+        , m_itemDepth(0)
+        , m_pagerDepth(0)
+    {
+    }
+
+    bool foundList;
+    bool foundNextPage;
+
+    void startElement(GumboTag tag, const GumboVector &attributes)
+    {
+        ++m_depth;
+        if (m_itemDepth > 0) {
+            m_item.startElement(tag, attributes);
+        }
+        else if (m_listDepth == 0) {
+            if (!foundList && RESULT_ITEMS.matches(tag, attributes)) {
+                foundList = true;
+                m_listDepth = m_depth;
+            }
+            else if (m_wantPager && m_pagerDepth == 0 && !m_pagerDone && PAGER.matches(tag, attributes)) {
+                m_pagerDepth = m_depth;
+            }
+            else if (m_pagerDepth > 0 && NEXT_PAGE.matches(tag, attributes)) {
+                foundNextPage = true;
+            }
+        }
+        else if (m_depth == m_listDepth + 1 && tag == GUMBO_TAG_LI && !m_options.isFull(m_results.size())) {
+            const char *className = gumboAttribute(attributes, "class");
+            const size_t prefixLength = strlen(SEARCH_RESULT_CLASS_PREFIX);
+            if (className && !strncmp(className, SEARCH_RESULT_CLASS_PREFIX, prefixLength)) {
+                m_className = className + prefixLength;
+                m_itemDepth = m_depth;
+                m_item.reset();
+                m_item.startElement(tag, attributes);
+            }
+        }
+    }
+
+    void endElement()
+    {
+        if (m_itemDepth > 0) {
+            m_item.endElement();
+            if (m_depth == m_itemDepth) {
+                m_itemDepth = 0;
+                addSearchResult(m_results, m_className.c_str(), m_item, m_options, m_stats);
+            }
+        }
+        else if (m_depth == m_listDepth) {
+            m_listDepth = 0;
+        }
+        else if (m_depth == m_pagerDepth) {
+            m_pagerDepth = 0;
+            m_pagerDone = true;
+        }
+        --m_depth;
+    }
+
+    void text(const char *text)
+    {
+        if (m_itemDepth > 0)
+            m_item.text(text);
+    }
+
+    bool done() const
+    {
+        const bool listDone = (foundList && m_listDepth == 0) || m_options.isFull(m_results.size());
+        return listDone && (!m_wantPager || foundNextPage || m_pagerDone);
+    }
+
+private:
+    vector<Result> &m_results;
+    const ScrapeOptions &m_options;
+    ScrapeStats *m_stats;
+    SearchResultVisitor m_item;
+    string m_className;
+    bool m_wantPager;
+    bool m_pagerDone;       // the first <div class='pager'> was closed
+    int m_depth;
+    int m_listDepth;        // > 0 while in <ul class='result-items'>
+    int m_itemDepth;        // > 0 while in one of its <li class='searchresult ...'> children
+    int m_pagerDepth;       // > 0 while in <div class='pager'>
+};
+
+vector<Result> searchResult(const char *html, size_t length, ScrapeParser *parser, bool *hasMorePages)
+{
+    const ScrapeOptions &options = ScrapeParserPrivate::optionsFor(parser);
+    SearchResultVisitor visitor(options);
+
+    vector<Result> ret;
+    ScrapeStats *stats = ScrapeParserPrivate::beginStats(parser, length);
+    if (hasMorePages)
+        *hasMorePages = false;
+
+#ifdef MUSICSCRAPE_TOKENIZER_BACKEND
+    if (options.htmlBackend == HtmlTokenizer) {
+        SearchPageVisitor pageVisitor(ret, options, stats, hasMorePages != nullptr);
+        {
+            ScrapeTimer tokenizerTimer(stats, &ScrapeStats::htmlParseNs);
+            ScrapeParserPrivate::tokenize(parser, html, length, pageVisitor);
+        }
+        if (stats)
+            stats->htmlParseNs -= std::min(stats->htmlParseNs, stats->assemblyNs);
+        if (!pageVisitor.foundList) {
+            SCRAPE_LOG() << "No <ul class='result-items'> found in HTML";
+            if (stats)
+                stats->skippedItems++;
+        }
+        if (hasMorePages)
+            *hasMorePages = pageVisitor.foundNextPage;
+        if (stats)
+            stats->resultCount = ret.size();
+        return ret;
+    }
+#endif
+
+    GumboOutput* output = ScrapeParserPrivate::parse(parser, html, length, stats);
+
+    ScrapeTimer findTimer(stats, &ScrapeStats::traversalNs);
+    GumboNode* resultItem = gumboFindFirst(output->root, RESULT_ITEMS);
+    if (hasMorePages) {
+        GumboNode *pager = gumboFindFirst(output->root, PAGER);
+        *hasMorePages = pager && gumboFindFirst(pager, NEXT_PAGE);
+    }
+    findTimer.stop();
+    if (!resultItem) {
+        SCRAPE_LOG() << "No <ul class='result-items'> found in HTML";
+        if (stats)
+            stats->skippedItems++;
+        goto out;
+    }
+
+    gumboForEach<GumboNode>(resultItem->v.element.children, [&](GumboNode *resultNode) {
+        if (options.isFull(ret.size()))
+            return;
+        if (resultNode->type != GUMBO_NODE_ELEMENT || resultNode->v.element.tag != GUMBO_TAG_LI)
+            return;
+
+        const char *className = gumboAttribute(resultNode, "class");
+        const size_t prefixLength = strlen(SEARCH_RESULT_CLASS_PREFIX);
+        if (!className || strncmp(className, SEARCH_RESULT_CLASS_PREFIX, prefixLength))
+            return;
+
+        ScrapeTimer traversalTimer(stats, &ScrapeStats::traversalNs);
+        visitor.reset();
+        gumboVisit(resultNode, visitor);
+        traversalTimer.stop();
+
+        addSearchResult(ret, className + prefixLength, visitor, options, stats);
+    });
+
+out:
+    ScrapeParserPrivate::destroy(parser, output);
+    if (stats)
+        stats->resultCount = ret.size();
+    return ret;
+}
+
+vector<Result> searchResult(const std::string &html, bool *hasMorePages)
+{
+    return searchResult(html.data(), html.size(), nullptr, hasMorePages);
+}
+
+std::string bandInfoUrl(const std::string &bandUrl)
+{
+    return bandUrl + "/music";
+}
+
+/**
+ * Parses the tralbum JSON with all values allocated from buffers.pool, and builds the track list.
+ * poolUsed is set to the memory the allocator needed, which may be more than the pool holds.
+ */
+static bool tralbumTracks(ResultList &ret, const string &title, const string &artist, const string &albumArtSrc,
+                          ScrapeParserPrivate::JsonBuffers &buffers, const ScrapeOptions &options, ScrapeStats *stats,
+                          size_t &poolUsed)
+{
+    const bool wantTitle = options.hasField(FieldTitle);
+    const bool wantMp3 = options.hasField(FieldMp3);
+
+    #define RETURN_IF(expression, log) if (expression) { SCRAPE_LOG() << log; if (stats) stats->skippedItems++; return false; }
+
+    // Parse JSON in place, with all values allocated from the pool
+    ScrapeTimer jsonTimer(stats, &ScrapeStats::jsonParseNs);
+    if (buffers.pool.size() < JSON_POOL_MIN_SIZE)
+        buffers.pool.resize(JSON_POOL_MIN_SIZE);
+
+    rapidjson::MemoryPoolAllocator<> allocator(buffers.pool.data(), buffers.pool.size());
+    rapidjson::Document tracksJson(&allocator);
+    tracksJson.ParseInsitu(&buffers.text[0]);
+    jsonTimer.stop();
+
+    poolUsed = allocator.Size();
+    RETURN_IF(tracksJson.HasParseError(), "Error while parsing Trackinfo JSON");
+    RETURN_IF(!tracksJson.HasMember("trackinfo"), "Malformed tralbum data");
 
     // gather album info from parsed JSON
     const rapidjson::Value &tracks = tracksJson["trackinfo"];
@@ -524,8 +1647,9 @@ static ResultList albumInfo(const std::string &html, GumboNode *root)
 
     bool isAlbum = (tracks.Size() > 1);
 
-    for (size_t i = 0; i < tracks.Size(); ++i) {
-        #define CONTINUE_IF(expression, log) if (expression) { SCRAPE_LOG() << log; continue; }
+    ScrapeTimer assemblyTimer(stats, &ScrapeStats::assemblyNs);
+    for (size_t i = 0; i < tracks.Size() && !options.isFull(ret.size()); ++i) {
+        #define CONTINUE_IF(expression, log) if (expression) { SCRAPE_LOG() << log; if (stats) stats->skippedItems++; continue; }
         const rapidjson::Value &track = tracks[i];
         CONTINUE_IF(!track.IsObject(), "trackinfo JSON: track not a string");
 
@@ -542,36 +1666,42 @@ static ResultList albumInfo(const std::string &html, GumboNode *root)
         CONTINUE_IF(titleIt == track.MemberEnd(), "trackinfo JSON: title attr missing");
         CONTINUE_IF(!titleIt->value.IsString(), "trackinfo JSON: title attr not a string");
 
-        const auto fileIt = track.FindMember("file");
-        CONTINUE_IF(fileIt == track.MemberEnd(), "trackinfo JSON: file attr missing");
-        CONTINUE_IF(!fileIt->value.IsObject(), "trackinfo JSON: file attr not an object");
+        string mp3file;
+        int mp3duration = -1;
+        if (wantMp3) {
+            const auto fileIt = track.FindMember("file");
+            CONTINUE_IF(fileIt == track.MemberEnd(), "trackinfo JSON: file attr missing");
+            CONTINUE_IF(!fileIt->value.IsObject(), "trackinfo JSON: file attr not an object");
 
-        const auto durationIt = track.FindMember("duration");
-        CONTINUE_IF(durationIt == track.MemberEnd(), "trackinfo JSON: duration attr missing");
-        CONTINUE_IF(!durationIt->value.IsNumber(), "trackinfo JSON: duration attr not a number");
+            const auto durationIt = track.FindMember("duration");
+            CONTINUE_IF(durationIt == track.MemberEnd(), "trackinfo JSON: duration attr missing");
+            CONTINUE_IF(!durationIt->value.IsNumber(), "trackinfo JSON: duration attr not a number");
 
-        const auto mp3It = fileIt->value.FindMember("mp3-128");
-        CONTINUE_IF(mp3It == fileIt->value.MemberEnd(), "trackinfo JSON: mp3-128 attr missing");
-        CONTINUE_IF(!mp3It->value.IsString(), "trackinfo JSON: mp3-128 not a string");
+            const auto mp3It = fileIt->value.FindMember("mp3-128");
+            CONTINUE_IF(mp3It == fileIt->value.MemberEnd(), "trackinfo JSON: mp3-128 attr missing");
+            CONTINUE_IF(!mp3It->value.IsString(), "trackinfo JSON: mp3-128 not a string");
+
+            mp3file.assign(mp3It->value.GetString(), mp3It->value.GetStringLength());
+            mp3duration = (int) durationIt->value.GetFloat();
+            CONTINUE_IF(mp3file.empty(), "trackinfo JSON: mp3 file empty");
+        }
 
         const auto trackNumIt = track.FindMember("track_num");
         isAlbum &= trackNumIt != track.MemberEnd() && trackNumIt->value.IsNumber();
 
-        const string trackTitle = titleIt->value.GetString();
-        const string mp3file = mp3It->value.GetString();
-
-        CONTINUE_IF(trackTitle.empty(), "trackinfo JSON: title empty");
-        CONTINUE_IF(mp3file.empty(), "trackinfo JSON: mp3 file empty");
+        CONTINUE_IF(titleIt->value.GetStringLength() == 0, "trackinfo JSON: title empty");
 
         Result result;
         result.resultType = Result::Track;
-        result.bandName = strTrimmed(artist);
+        result.bandName = artist;
         if (isAlbum)
-            result.albumName = strTrimmed(title);
-        result.trackName = trackTitle;
-        result.trackNum = (trackNumIt != track.MemberEnd()) ? trackNumIt->value.GetInt() : -1;
-        result.mp3url = mp3file;
-        result.mp3duration = (int) durationIt->value.GetFloat();
+            result.albumName = title;
+        if (wantTitle)
+            result.trackName.assign(titleIt->value.GetString(), titleIt->value.GetStringLength());
+        const bool hasTrackNum = trackNumIt != track.MemberEnd() && trackNumIt->value.IsNumber();
+        result.trackNum = (hasTrackNum && options.hasField(FieldTrackNum)) ? trackNumIt->value.GetInt() : -1;
+        result.mp3url = std::move(mp3file);
+        result.mp3duration = mp3duration;
         result.artUrl = albumArtSrc;
         ret.push_back(result);
 
@@ -580,22 +1710,124 @@ static ResultList albumInfo(const std::string &html, GumboNode *root)
 
     #undef RETURN_IF
 
+    return true;
+}
+
+/**
+ * Builds the track list from the tralbum JSON, which has already been copied to buffers.text
+ * and is parsed in place. Returns false if the JSON is unusable.
+ */
+static bool tralbumResults(ResultList &ret, const string &title, const string &artist, const string &albumArtSrc,
+                           ScrapeParserPrivate::JsonBuffers &buffers, const ScrapeOptions &options, ScrapeStats *stats)
+{
+    size_t poolUsed = 0;
+    const bool ok = tralbumTracks(ret, title, artist, albumArtSrc, buffers, options, stats, poolUsed);
+
+    // let the next page fit into the pool without any further chunks. The Document and its
+    // allocator, which point into the pool, are gone by now.
+    if (poolUsed > buffers.pool.size())
+        buffers.pool.resize(poolUsed + poolUsed / 4);
+    return ok;
+}
+
+static ResultList albumInfo(GumboNode *root, ScrapeParser *parser, ScrapeStats *stats)
+{
+    ResultList ret;
+    const ScrapeOptions &options = ScrapeParserPrivate::optionsFor(parser);
+    const bool wantTitle = options.hasField(FieldTitle);
+    const bool wantBandName = options.hasField(FieldBandName);
+    const bool wantArt = options.hasField(FieldArtUrl);
+
+    #define RETURN_IF(expression, log) if (expression) { SCRAPE_LOG() << log; if (stats) stats->skippedItems++; return ret; }
+
+    ScrapeTimer traversalTimer(stats, &ScrapeStats::traversalNs);
+
+    // get band name and track/album title
+    const char *title = "";
+    const char *artist = "";
+    if (wantTitle || wantBandName) {
+        GumboNode *bandNode = gumboFindFirst(root, NAME_SECTION);
+        RETURN_IF(!bandNode, "No <div id='name-section'> node");
+        if (wantTitle) {
+            GumboNode *titleNode = gumboFindFirst(bandNode, TRACK_TITLE);
+            RETURN_IF(!titleNode, "No <h2 class='trackTitle'> node");
+            title = gumboFindFirstText(titleNode);
+            RETURN_IF(!title, "No text in <h2 class='trackTitle'> node");
+        }
+        if (wantBandName) {
+            GumboNode *artistNode = gumboFindFirst(bandNode, ANCHOR);
+            RETURN_IF(!artistNode, "No artist <a> node");
+            artist = gumboFindFirstText(artistNode);
+            RETURN_IF(!artist, "No artist <a> node text");
+        }
+    }
+
+    // get album art
+    string albumArtSrc;
+    if (wantArt) {
+        GumboNode *albumArtNode = gumboFindFirst(root, TRALBUM_ART);
+        RETURN_IF(!albumArtNode, "No <div id='tralbumArt'> node");
+        GumboNode *albumArtImg = gumboFindFirst(albumArtNode, IMG);
+        RETURN_IF(!albumArtImg, "No <img> in <div id='tralbumArt'> node");
+        albumArtSrc = gumboGetAttributeValue(albumArtImg, "src");
+        RETURN_IF(albumArtSrc.empty(), "Empty <img> in <div id='tralbumArt'> node");
+    }
+
+    // Look for tralbum JSON, there has to be exactly one
+    const char *tracksJsonStr = nullptr;
+    int tralbumCount = 0;
+    gumboTraverse(root, [&](GumboNode *node) {
+        if (node->type != GUMBO_NODE_ELEMENT)
+            return GumboSkipChildren;
+        if (!TRALBUM_SCRIPT.matches(node))
+            return GumboDescend;
+        const char *value = gumboAttribute(node, "data-tralbum");
+        if (!*value)
+            return GumboSkipChildren;
+        tracksJsonStr = value;
+        return ++tralbumCount > 1 ? GumboStop : GumboSkipChildren;
+    });
+    RETURN_IF(tralbumCount == 0, "Could'nt find tralbum script element");
+    RETURN_IF(tralbumCount > 1, "Found more than one tralbum script element");
+    traversalTimer.stop();
+
+    // copy the attribute value, which is then parsed in place
+    ScrapeParserPrivate::JsonBuffers localBuffers;
+    ScrapeParserPrivate::JsonBuffers &buffers = ScrapeParserPrivate::jsonBuffers(parser, localBuffers);
+    buffers.text.assign(tracksJsonStr);
+    tralbumResults(ret, strTrimmed(title), strTrimmed(artist), albumArtSrc, buffers, options, stats);
+
+    #undef RETURN_IF
+
     return ret;
 }
 
-ResultList bandInfoResult(const std::string &bandUrl, const std::string &html, bool *isSingleRelease)
+ResultList bandInfoResult(const std::string &bandUrl, const char *html, size_t length,
+                          bool *isSingleRelease, ScrapeParser *parser)
 {
     vector<Result> ret;
-    GumboOutput* output = gumbo_parse(html.data());
+    ScrapeStats *stats = ScrapeParserPrivate::beginStats(parser, length);
+    const ScrapeOptions &options = ScrapeParserPrivate::optionsFor(parser);
+    const bool wantTitle = options.hasField(FieldTitle);
+    const bool wantArt = options.hasField(FieldArtUrl);
+    GumboOutput* output = ScrapeParserPrivate::parse(parser, html, length, stats);
 
     // get band name
-    GumboNode *bandNode = gumboFindFirst(output->root, GUMBO_TAG_P, {{"id", "band-name-location"}});
-    GumboNode *titleNode = bandNode ? gumboFindFirst(bandNode, GUMBO_TAG_SPAN, {{"class", "title"}}) : nullptr;
-    const char *bandName = titleNode ? gumboFindFirstText(titleNode, "") : "";
+    ScrapeTimer traversalTimer(stats, &ScrapeStats::traversalNs);
+    const char *bandName = "";
+    if (options.hasField(FieldBandName)) {
+        GumboNode *bandNode = gumboFindFirst(output->root, BAND_NAME_LOCATION);
+        GumboNode *titleNode = bandNode ? gumboFindFirst(bandNode, SPAN_TITLE) : nullptr;
+        bandName = titleNode ? gumboFindFirstText(titleNode, "") : "";
+    }
 
     // go through releases
-    const vector<GumboNode*> aNodes = gumboFind(output->root, GUMBO_TAG_A, {}, true);
+    const vector<GumboNode*> aNodes = gumboFind(output->root, ANCHOR, true);
+    traversalTimer.stop();
     for (GumboNode *aNode : aNodes) {
+        if (options.isFull(ret.size()))
+            break;
+        ScrapeTimer nodeTimer(stats, &ScrapeStats::traversalNs);
         const string href = gumboGetAttributeValue(aNode, "href");
 
         const bool isAlbum = strStartsWith(href, "/album/");
@@ -603,23 +1835,32 @@ ResultList bandInfoResult(const std::string &bandUrl, const std::string &html, b
         if (!isAlbum && !isTrack)
             continue;
 
-        #define CONTINUE_IF(expression, log) if (expression) { SCRAPE_LOG() << log; continue; }
+        #define CONTINUE_IF(expression, log) if (expression) { SCRAPE_LOG() << log; if (stats) stats->skippedItems++; continue; }
 
-        GumboNode *titleNode = gumboFindFirst(aNode, GUMBO_TAG_P, {{"class", "title"}});
-        CONTINUE_IF(!titleNode, "No <p class='title'> node in album/track element");
-        const char *title = gumboFindFirstText(titleNode);
-        CONTINUE_IF(!title, "No valid title text in <p class='title'> node");
+        const char *title = "";
+        if (wantTitle) {
+            GumboNode *titleNode = gumboFindFirst(aNode, P_TITLE);
+            CONTINUE_IF(!titleNode, "No <p class='title'> node in album/track element");
+            title = gumboFindFirstText(titleNode);
+            CONTINUE_IF(!title, "No valid title text in <p class='title'> node");
+        }
 
-        GumboNode *artNode = gumboFindFirst(aNode, GUMBO_TAG_DIV, {{"class", "art"}});
-        CONTINUE_IF(!artNode, "No <div class='art'> node in album/track element");
-        GumboNode *artImgNode = gumboFindFirst(artNode, GUMBO_TAG_IMG);
-        CONTINUE_IF(!artNode, "No <img> node in album/track element");
-        const string artUrl = gumboGetAttributeValue(artImgNode, "src");
-        CONTINUE_IF(artUrl.empty(), "No valid src= value in album/track art element");
+        string artUrl;
+        if (wantArt) {
+            GumboNode *artNode = gumboFindFirst(aNode, ART);
+            CONTINUE_IF(!artNode, "No <div class='art'> node in album/track element");
+            GumboNode *artImgNode = gumboFindFirst(artNode, IMG);
+            CONTINUE_IF(!artImgNode, "No <img> node in album/track element");
+            artUrl = gumboGetAttributeValue(artImgNode, "src");
+            CONTINUE_IF(artUrl.empty(), "No valid src= value in album/track art element");
+        }
+        nodeTimer.stop();
 
+        ScrapeTimer assemblyTimer(stats, &ScrapeStats::assemblyNs);
         Result result;
         result.bandName = strTrimmed(bandName);
-        result.url = bandUrl + href;
+        if (options.hasField(FieldUrl))
+            result.url = bandUrl + href;
         result.artUrl = strTrimmed(artUrl);
         result.trackNum = -1;
         result.mp3duration = -1;
@@ -642,80 +1883,1391 @@ ResultList bandInfoResult(const std::string &bandUrl, const std::string &html, b
     // directly (for artists with only 1 release)
     const bool singleRelease = ret.empty();
     if (singleRelease) 
-        ret = albumInfo(html, output->root);
+        ret = albumInfo(output->root, parser, stats);
     if (isSingleRelease)
         *isSingleRelease = singleRelease;
 
-    gumbo_destroy_output(&kGumboDefaultOptions, output);
+    ScrapeParserPrivate::destroy(parser, output);
+    if (stats)
+        stats->resultCount = ret.size();
     return ret;
 }
 
-ResultList albumInfo(const std::string &html)
+ResultList bandInfoResult(const std::string &bandUrl, const std::string &html, bool *isSingleRelease)
 {
-    GumboOutput* output = gumbo_parse(html.data());
-    const vector<Result> ret = albumInfo(html, output->root);
-    gumbo_destroy_output(&kGumboDefaultOptions, output);
-    return ret;
+    return bandInfoResult(bandUrl, html.data(), html.size(), isSingleRelease);
 }
 
+/**
+ * Fast path for album and track pages: finds the few elements that albumInfo() needs by scanning
+ * the raw HTML, without building a tree. Returns false if anything doesn't look exactly as expected,
+ * in which case the page has to be parsed by Gumbo.
+ */
+static bool albumInfoScan(const char *html, size_t length, ScrapeParser *parser, ScrapeStats *stats, ResultList &ret)
+{
+    const ScrapeOptions &options = ScrapeParserPrivate::optionsFor(parser);
+    const char *end = html + length;
+
+    ScrapeTimer traversalTimer(stats, &ScrapeStats::traversalNs);
+
+    // band name and track/album title, from the name section up to its first </div>
+    string title;
+    string artist;
+    if (options.hasField(FieldTitle) || options.hasField(FieldBandName)) {
+        const char *section = htmlFindStartTag(html, end, "div", "id=\"name-section\"");
+        if (!section)
+            return false;
+        const char *sectionEnd = memFind(section, end, "</div>");
+        if (!sectionEnd || memFind(section, sectionEnd, "<div"))
+            return false;
+
+        if (options.hasField(FieldTitle)) {
+            const char *titleStart = htmlFindStartTag(section, sectionEnd, "h2", "class=\"trackTitle\"");
+            if (!titleStart || !htmlElementText(titleStart, sectionEnd, title))
+                return false;
+        }
+        if (options.hasField(FieldBandName)) {
+            const char *anchor = memFind(section, sectionEnd, "<a");
+            while (anchor && !htmlTagIs(anchor, sectionEnd, "a"))
+                anchor = memFind(anchor + 2, sectionEnd, "<a");
+            const char *anchorEnd = anchor ? (const char*) memchr(anchor, '>', sectionEnd - anchor) : nullptr;
+            if (!anchorEnd || !htmlElementText(anchorEnd + 1, sectionEnd, artist))
+                return false;
+        }
+    }
 
-} // namespace ScrapeBandcamp
-
-namespace ScrapeYoutube {
+    // the first <img> in the album art <div>
+    string albumArtSrc;
+    if (options.hasField(FieldArtUrl)) {
+        const char *art = htmlFindStartTag(html, end, "div", "id=\"tralbumArt\"");
+        const char *img = art ? memFind(art, end, "<img") : nullptr;
+        const char *artEnd = art ? memFind(art, end, "</div>") : nullptr;
+        const char *srcBegin, *srcEnd;
+        if (!img || !artEnd || artEnd < img || !htmlTagIs(img, end, "img")
+                || !htmlAttributeValue(img, end, " src=\"", &srcBegin, &srcEnd)
+                || !htmlDecode(srcBegin, srcEnd, albumArtSrc) || albumArtSrc.empty())
+            return false;
+    }
 
-string searchUrl(const string &pattern)
-{
-    return "https://www.youtube.com/results?search_query=" + percentEncode(pattern);
+    // tralbum JSON, decoded straight into the buffer that is parsed in place
+    static const char *TRALBUM_ATTRIBUTE = " data-tralbum=\"";
+    const char *tralbum = memFind(html, end, TRALBUM_ATTRIBUTE);
+    const char *scriptStart = tralbum ? htmlTagStart(html, tralbum) : nullptr;
+    if (!scriptStart || !htmlTagIs(scriptStart, end, "script"))
+        return false;
+    const char *jsonBegin = tralbum + strlen(TRALBUM_ATTRIBUTE);
+    const char *jsonEnd = (const char*) memchr(jsonBegin, '"', end - jsonBegin);
+    if (!jsonEnd || jsonEnd == jsonBegin)
+        return false;
+    // leave pages with another tralbum attribute to Gumbo, which rejects them
+    if (memFind(jsonEnd, end, TRALBUM_ATTRIBUTE))
+        return false;
+
+    ScrapeParserPrivate::JsonBuffers localBuffers;
+    ScrapeParserPrivate::JsonBuffers &buffers = ScrapeParserPrivate::jsonBuffers(parser, localBuffers);
+    buffers.text.clear();
+    if (!htmlDecode(jsonBegin, jsonEnd, buffers.text))
+        return false;
+    traversalTimer.stop();
+
+    return tralbumResults(ret, strTrimmed(title), strTrimmed(artist), albumArtSrc, buffers, options, stats);
 }
 
-ResultList searchResult(const string &html)
+/**
+ * Collects the elements that albumInfo() needs from a stream of tags, for the tokenizer backend.
+ * Each one is the first match in document order, as gumboFindFirst() would return. The tralbum
+ * scripts are counted, since a page with more than one is rejected.
+ */
+class AlbumPageVisitor
 {
-    GumboOutput* output = gumbo_parse(html.data());
-
-    ResultList ret;
+public:
+    struct Element
+    {
+        bool found;
+        int depth;          // > 0 while the element is open
+    };
+
+    Element nameSection;
+    Element trackTitle;
+    Element artist;
+    Element art;
+    bool foundArtImg;
+    int tralbumCount;
+    const char *title;      // nullptr until the first text in the element was found
+    const char *artistName;
+    string titleText;
+    string artistText;
+    string artSrc;
+
+    AlbumPageVisitor(const ScrapeOptions &options, string &tralbumJson)
+        : foundArtImg(false)
+        , tralbumCount(0)
+        , title(nullptr)
+        , artistName(nullptr)
+        , m_wantTitle(options.hasField(FieldTitle))
+        , m_wantBandName(options.hasField(FieldBandName))
+        , m_wantArt(options.hasField(FieldArtUrl))
+        , m_tralbumJson(tralbumJson)
+        , m_depth(0)
+    {
+        for (Element *element : elements())
+            *element = Element{false, 0};
+    }
 
-    // find <script> element with data
-    const vector<GumboNode*> scriptElements = gumboFind(output->root, GUMBO_TAG_SCRIPT, {}, true);
-    for (GumboNode *scriptElem : scriptElements) {
-        const char *scriptText = gumboFindFirstText(scriptElem);
-        if (!scriptText)
-            continue;
+    void startElement(GumboTag tag, const GumboVector &attributes)
+    {
+        ++m_depth;
+
+        if ((m_wantTitle || m_wantBandName) && !nameSection.found && NAME_SECTION.matches(tag, attributes))
+            open(nameSection);
+        if (nameSection.depth > 0) {
+            if (m_wantTitle && !trackTitle.found && TRACK_TITLE.matches(tag, attributes))
+                open(trackTitle);
+            if (m_wantBandName && !artist.found && ANCHOR.matches(tag, attributes))
+                open(artist);
+        }
 
-        const string text(scriptText);
-        const char *needle = "var ytInitialData = ";
-        const size_t pos = text.find(needle);
-        if (pos == string::npos)
-            continue;
+        if (m_wantArt && !art.found && TRALBUM_ART.matches(tag, attributes))
+            open(art);
+        if (art.depth > 0 && !foundArtImg && IMG.matches(tag, attributes)) {
+            foundArtImg = true;
+            const char *src = gumboAttribute(attributes, "src");
+            artSrc = src ? src : "";
+        }
 
-        const string jsonStr = text.substr(pos + strlen(needle));
+        if (TRALBUM_SCRIPT.matches(tag, attributes)) {
+            const char *value = gumboAttribute(attributes, "data-tralbum");
+            if (value && *value && ++tralbumCount == 1)
+                m_tralbumJson.assign(value);
+        }
+    }
 
-        rapidjson::Document json;
-        json.Parse<rapidjson::kParseStopWhenDoneFlag>(jsonStr.data());
-        if (json.HasParseError()) {
-            SCRAPE_LOG() << "Error while parsing Trackinfo JSON: "
-                         << json.GetParseError() <<" (line " << json.GetErrorOffset() << ")";
-            continue;
+    void endElement()
+    {
+        for (Element *element : elements()) {
+            if (element->depth == m_depth)
+                element->depth = 0;
         }
+        --m_depth;
+    }
 
-        const vector<rapidjson::Document> videos = jsonFindMembers(json, "videoRenderer");
-        for (const rapidjson::Document &video : videos) {
-            const rapidjson::Value* id = rapidjson::Pointer("/videoId").Get(video);
-            const rapidjson::Value* title = rapidjson::Pointer("/title/runs/0/text").Get(video);
-            const rapidjson::Value* thumbnail = rapidjson::Pointer("/thumbnail/thumbnails/0/url").Get(video);
-            if (id && id->IsString()
-                    && title && title->IsString()
-                    && thumbnail && thumbnail->IsString()) {
-                std::string prefix = "https://www.youtube.com/watch?v=";
-                ret.push_back(Result{title->GetString(), prefix + id->GetString(), thumbnail->GetString(), ""});
+    void text(const char *text)
+    {
+        if (trackTitle.depth > 0 && !title) {
+            titleText = text;
+            title = titleText.c_str();
+        }
+        if (artist.depth > 0 && !artistName) {
+            artistText = text;
+            artistName = artistText.c_str();
+        }
+    }
+
+    bool done() const
+    {
+        // a second tralbum script rejects the page, otherwise the whole page has to be seen
+        return tralbumCount > 1;
+    }
+
+private:
+    array<Element*, 4> elements()
+    {
+        return {{&nameSection, &trackTitle, &artist, &art}};
+    }
+
+    void open(Element &element)
+    {
+        element.found = true;
+        element.depth = m_depth;
+    }
+
+    bool m_wantTitle;
+    bool m_wantBandName;
+    bool m_wantArt;
+    string &m_tralbumJson;
+    int m_depth;
+};
+
+#ifdef MUSICSCRAPE_TOKENIZER_BACKEND
+static void albumInfoTokenizer(const char *html, size_t length, ScrapeParser *parser, ScrapeStats *stats, ResultList &ret)
+{
+    const ScrapeOptions &options = ScrapeParserPrivate::optionsFor(parser);
+    ScrapeParserPrivate::JsonBuffers localBuffers;
+    ScrapeParserPrivate::JsonBuffers &buffers = ScrapeParserPrivate::jsonBuffers(parser, localBuffers);
+
+    AlbumPageVisitor visitor(options, buffers.text);
+    ScrapeTimer tokenizerTimer(stats, &ScrapeStats::htmlParseNs);
+    ScrapeParserPrivate::tokenize(parser, html, length, visitor);
+    tokenizerTimer.stop();
+
+    #define RETURN_IF(expression, log) if (expression) { SCRAPE_LOG() << log; if (stats) stats->skippedItems++; return; }
+
+    if (options.hasField(FieldTitle) || options.hasField(FieldBandName))
+        RETURN_IF(!visitor.nameSection.found, "No <div id='name-section'> node");
+    if (options.hasField(FieldTitle)) {
+        RETURN_IF(!visitor.trackTitle.found, "No <h2 class='trackTitle'> node");
+        RETURN_IF(!visitor.title, "No text in <h2 class='trackTitle'> node");
+    }
+    if (options.hasField(FieldBandName)) {
+        RETURN_IF(!visitor.artist.found, "No artist <a> node");
+        RETURN_IF(!visitor.artistName, "No artist <a> node text");
+    }
+    if (options.hasField(FieldArtUrl)) {
+        RETURN_IF(!visitor.art.found, "No <div id='tralbumArt'> node");
+        RETURN_IF(!visitor.foundArtImg, "No <img> in <div id='tralbumArt'> node");
+        RETURN_IF(visitor.artSrc.empty(), "Empty <img> in <div id='tralbumArt'> node");
+    }
+    RETURN_IF(visitor.tralbumCount == 0, "Could'nt find tralbum script element");
+    RETURN_IF(visitor.tralbumCount > 1, "Found more than one tralbum script element");
+
+    #undef RETURN_IF
+
+    tralbumResults(ret, strTrimmed(visitor.titleText), strTrimmed(visitor.artistText), visitor.artSrc,
+                   buffers, options, stats);
+}
+#endif
+
+ResultList albumInfo(const char *html, size_t length, ScrapeParser *parser)
+{
+    ScrapeStats *stats = ScrapeParserPrivate::beginStats(parser, length);
+    const ScrapeOptions &options = ScrapeParserPrivate::optionsFor(parser);
+
+    ResultList ret;
+    if (!options.fastPaths || !albumInfoScan(html, length, parser, stats, ret)) {
+        if (options.fastPaths && stats) {
+            // the DOM path runs into the same malformed items again
+            stats->skippedItems = 0;
+            stats->fallback = true;
+        }
+        ret.clear();
+#ifdef MUSICSCRAPE_TOKENIZER_BACKEND
+        if (options.htmlBackend == HtmlTokenizer) {
+            albumInfoTokenizer(html, length, parser, stats, ret);
+        }
+        else
+#endif
+        {
+            GumboOutput* output = ScrapeParserPrivate::parse(parser, html, length, stats);
+            ret = albumInfo(output->root, parser, stats);
+            ScrapeParserPrivate::destroy(parser, output);
+        }
+    }
+
+    if (stats)
+        stats->resultCount = ret.size();
+    return ret;
+}
+
+ResultList albumInfo(const std::string &html)
+{
+    return albumInfo(html.data(), html.size());
+}
+
+static const char *SEARCH_RESULT_CLASS = "class=\"searchresult ";
+
+/**
+ * Runs a SearchResultVisitor for the <li class='searchresult ...'> element that a piece of the
+ * search page starts with, for the SearchResultStream. With wantPager, it goes on to the
+ * <div class='pager'> after it, and looks for the link to the next page.
+ */
+class SearchItemVisitor
+{
+public:
+    SearchItemVisitor(vector<Result> &results, const ScrapeOptions &options, bool wantPager)
+        : foundItem(false)
+        , foundNextPage(false)
+        , m_results(results)
+        , m_options(options)
+        , m_item(options)
+        , m_wantPager(wantPager)
+        , m_failed(false)
+        , m_pagerDone(false)
+        , m_depth(0)
+        , m_itemDepth(0)
+        , m_pagerDepth(0)
+    {
+    }
+
+    bool foundItem;
+    bool foundNextPage;
+
+    void startElement(GumboTag tag, const GumboVector &attributes)
+    {
+        ++m_depth;
+        if (m_itemDepth > 0) {
+            m_item.startElement(tag, attributes);
+        }
+        else if (!foundItem) {
+            const char *className = gumboAttribute(attributes, "class");
+            const size_t prefixLength = strlen(SEARCH_RESULT_CLASS_PREFIX);
+            if (m_depth != 1 || tag != GUMBO_TAG_LI || !className
+                    || strncmp(className, SEARCH_RESULT_CLASS_PREFIX, prefixLength)) {
+                m_failed = true;
+                return;
+            }
+            foundItem = true;
+            if (!m_options.isFull(m_results.size())) {
+                m_className = className + prefixLength;
+                m_itemDepth = m_depth;
+                m_item.reset();
+                m_item.startElement(tag, attributes);
+            }
+        }
+        else if (m_wantPager && m_pagerDepth == 0 && !m_pagerDone && PAGER.matches(tag, attributes)) {
+            m_pagerDepth = m_depth;
+        }
+        else if (m_pagerDepth > 0 && NEXT_PAGE.matches(tag, attributes)) {
+            foundNextPage = true;
+        }
+    }
+
+    void endElement()
+    {
+        if (m_itemDepth > 0) {
+            m_item.endElement();
+            if (m_depth == m_itemDepth) {
+                m_itemDepth = 0;
+                addSearchResult(m_results, m_className.c_str(), m_item, m_options, nullptr);
+            }
+        }
+        else if (m_depth == m_pagerDepth) {
+            m_pagerDepth = 0;
+            m_pagerDone = true;
+        }
+        --m_depth;
+    }
+
+    void text(const char *text)
+    {
+        if (m_itemDepth > 0)
+            m_item.text(text);
+    }
+
+    bool done() const
+    {
+        return m_failed || (foundItem && m_itemDepth == 0 && (!m_wantPager || foundNextPage || m_pagerDone));
+    }
+
+private:
+    vector<Result> &m_results;
+    const ScrapeOptions &m_options;
+    SearchResultVisitor m_item;
+    string m_className;
+    bool m_wantPager;
+    bool m_failed;          // the piece didn't start with the item
+    bool m_pagerDone;       // the first <div class='pager'> was closed
+    int m_depth;
+    int m_itemDepth;        // > 0 while in the <li class='searchresult ...'> element
+    int m_pagerDepth;       // > 0 while in <div class='pager'>
+};
+
+struct SearchResultStreamPrivate
+{
+    SearchResultStreamPrivate(ScrapeParser *parser)
+        : parser(parser)
+        , options(ScrapeParserPrivate::optionsFor(parser))
+        , itemStart(string::npos)
+        , scanPos(0)
+        , taken(0)
+        , hasMorePages(false)
+    {
+    }
+
+    // the start of the next <li class='searchresult ...'> tag after scanPos, with the same
+    // checks as htmlFindStartTag(). Matches of the class outside of such a tag are skipped.
+    size_t findItem()
+    {
+        const char *begin = buffer.data();
+        const char *end = begin + buffer.size();
+        while (const char *match = memFind(begin + scanPos, end, SEARCH_RESULT_CLASS)) {
+            scanPos = match - begin + 1;
+            const char *tagStart = htmlTagStart(begin, match);
+            if (tagStart && htmlTagIs(tagStart, end, "li") && std::isspace((unsigned char) match[-1]))
+                return tagStart - begin;
+        }
+
+        // a match may still be cut off at the end, along with the start of its tag
+        const size_t classLength = strlen(SEARCH_RESULT_CLASS);
+        if (buffer.size() >= classLength)
+            scanPos = std::max(scanPos, buffer.size() - classLength + 1);
+        return string::npos;
+    }
+
+    // the start of the data that findItem() may still need to look back into
+    size_t openTagStart() const
+    {
+        const size_t pos = buffer.rfind('<', scanPos);
+        return (pos != string::npos && buffer.find('>', pos) == string::npos) ? pos : scanPos;
+    }
+
+    // parses the <li> in [begin, end) on its own. The last one is followed by the rest of
+    // the page, with the pager.
+    void parseItem(size_t begin, size_t end, bool *itemHasMorePages = nullptr)
+    {
+        if (!itemHasMorePages && options.isFull(results.size()))
+            return;
+
+        SearchItemVisitor visitor(results, options, itemHasMorePages != nullptr);
+#ifdef MUSICSCRAPE_TOKENIZER_BACKEND
+        ScrapeParserPrivate::tokenize(parser, buffer.data() + begin, end - begin, visitor);
+#else
+        // the tree builder puts the item, and whatever follows it, into the <body>
+        GumboOutput *output = ScrapeParserPrivate::parse(parser, buffer.data() + begin, end - begin);
+        const GumboVector &children = output->root->v.element.children;
+        for (unsigned int i = 0; i < children.length; ++i) {
+            const GumboNode *child = static_cast<GumboNode*>(children.data[i]);
+            if (child->type != GUMBO_NODE_ELEMENT || child->v.element.tag != GUMBO_TAG_BODY)
+                continue;
+            const GumboVector &nodes = child->v.element.children;
+            for (unsigned int j = 0; j < nodes.length && !visitor.done(); ++j)
+                gumboVisit(static_cast<GumboNode*>(nodes.data[j]), visitor);
+        }
+        ScrapeParserPrivate::destroy(parser, output);
+#endif
+        if (!visitor.foundItem)
+            SCRAPE_LOG() << "Search result doesn't start with an <li class='searchresult ...'> element";
+        if (itemHasMorePages)
+            *itemHasMorePages = visitor.foundNextPage;
+    }
+
+    ScrapeParser *parser;
+    ScrapeOptions options;
+    string buffer;
+    size_t itemStart;   // start of the current <li> in buffer, if any
+    size_t scanPos;
+    ResultList results;
+    size_t taken;
+    bool hasMorePages;
+};
+
+SearchResultStream::SearchResultStream(ScrapeParser *parser)
+    : d(new SearchResultStreamPrivate(parser))
+{
+}
+
+SearchResultStream::~SearchResultStream()
+{
+    delete d;
+}
+
+void SearchResultStream::feed(const char *data, size_t length)
+{
+    d->buffer.append(data, length);
+
+    // an item is complete once the next one starts
+    size_t pos;
+    while ((pos = d->findItem()) != string::npos) {
+        if (d->itemStart != string::npos)
+            d->parseItem(d->itemStart, pos);
+        d->itemStart = pos;
+    }
+
+    // drop everything before the current item, or before a tag that may still turn out to be one
+    const size_t keep = (d->itemStart != string::npos) ? d->itemStart : d->openTagStart();
+    d->buffer.erase(0, keep);
+    d->scanPos -= keep;
+    if (d->itemStart != string::npos)
+        d->itemStart = 0;
+}
+
+void SearchResultStream::finish()
+{
+    if (d->itemStart != string::npos)
+        d->parseItem(d->itemStart, d->buffer.size(), &d->hasMorePages);
+    d->itemStart = string::npos;
+    d->buffer.clear();
+    d->scanPos = 0;
+}
+
+ResultList SearchResultStream::takeNewResults()
+{
+    const ResultList ret(d->results.begin() + d->taken, d->results.end());
+    d->taken = d->results.size();
+    return ret;
+}
+
+const ResultList &SearchResultStream::results() const
+{
+    return d->results;
+}
+
+bool SearchResultStream::hasMorePages() const
+{
+    return d->hasMorePages;
+}
+
+} // namespace ScrapeBandcamp
+
+namespace ScrapeYoutube {
+
+static const char *YT_INITIAL_DATA = "var ytInitialData = ";
+static const char *VIDEO_URL_PREFIX = "https://www.youtube.com/watch?v=";
+static const char *CHANNEL_URL_PREFIX = "https://www.youtube.com/channel/";
+static const char *INNERTUBE_API_KEY = "\"INNERTUBE_API_KEY\":\"";
+static const char *INNERTUBE_CLIENT_VERSION = "\"INNERTUBE_CLIENT_VERSION\":\"";
+
+string searchUrl(const string &pattern)
+{
+    return "https://www.youtube.com/results?search_query=" + percentEncode(pattern);
+}
+
+string continuationUrl(const Continuation &continuation)
+{
+    string ret = "https://www.youtube.com/youtubei/v1/search";
+    if (!continuation.apiKey.empty())
+        ret += "?key=" + percentEncode(continuation.apiKey);
+    return ret;
+}
+
+string continuationBody(const Continuation &continuation)
+{
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    writer.StartObject();
+    writer.Key("context");
+    writer.StartObject();
+    writer.Key("client");
+    writer.StartObject();
+    writer.Key("clientName");
+    writer.String("WEB");
+    writer.Key("clientVersion");
+    writer.String(continuation.clientVersion.data(), (rapidjson::SizeType) continuation.clientVersion.size());
+    writer.EndObject();
+    writer.EndObject();
+    writer.Key("continuation");
+    writer.String(continuation.token.data(), (rapidjson::SizeType) continuation.token.size());
+    writer.EndObject();
+    return string(buffer.GetString(), buffer.GetSize());
+}
+
+/**
+ * Value of a "key":"value" pair in the ytcfg script, which holds plain identifiers only
+ */
+static string scanConfigString(const char *html, size_t length, const char *key)
+{
+    const char *end = html + length;
+    const char *pos = memFind(html, end, key);
+    if (!pos)
+        return string();
+    pos += strlen(key);
+    const char *valueEnd = (const char*) memchr(pos, '"', end - pos);
+    return valueEnd ? string(pos, valueEnd) : string();
+}
+
+// one (key, index) component of a JSON path, relative to a renderer object. Array elements have no key.
+struct JsonPathElem
+{
+    const char *key;
+    rapidjson::SizeType index;
+};
+
+struct JsonPath
+{
+    const JsonPathElem *elems;
+    size_t length;
+};
+
+template <size_t N>
+static JsonPath jsonPath(const JsonPathElem (&elems)[N])
+{
+    return JsonPath{elems, N};
+}
+
+static const JsonPathElem VIDEO_ID_PATH[] = {{"videoId", 0}};
+static const JsonPathElem PLAYLIST_ID_PATH[] = {{"playlistId", 0}};
+static const JsonPathElem CHANNEL_ID_PATH[] = {{"channelId", 0}};
+static const JsonPathElem PLAYLIST_VIDEO_ID_PATH[] = {{"navigationEndpoint", 0}, {"watchEndpoint", 0}, {"videoId", 0}};
+static const JsonPathElem TITLE_RUNS_PATH[] = {{"title", 0}, {"runs", 0}, {nullptr, 0}, {"text", 0}};
+static const JsonPathElem TITLE_SIMPLE_PATH[] = {{"title", 0}, {"simpleText", 0}};
+static const JsonPathElem THUMBNAIL_PATH[] = {{"thumbnail", 0}, {"thumbnails", 0}, {nullptr, 0}, {"url", 0}};
+static const JsonPathElem PLAYLIST_THUMBNAIL_PATH[] = {{"thumbnails", 0}, {nullptr, 0}, {"thumbnails", 0}, {nullptr, 0}, {"url", 0}};
+
+// the same paths for the DOM, parsed once instead of for every renderer
+static const rapidjson::Pointer VIDEO_ID_POINTER("/videoId");
+static const rapidjson::Pointer PLAYLIST_ID_POINTER("/playlistId");
+static const rapidjson::Pointer CHANNEL_ID_POINTER("/channelId");
+static const rapidjson::Pointer PLAYLIST_VIDEO_ID_POINTER("/navigationEndpoint/watchEndpoint/videoId");
+static const rapidjson::Pointer TITLE_RUNS_POINTER("/title/runs/0/text");
+static const rapidjson::Pointer TITLE_SIMPLE_POINTER("/title/simpleText");
+static const rapidjson::Pointer THUMBNAIL_POINTER("/thumbnail/thumbnails/0/url");
+static const rapidjson::Pointer PLAYLIST_THUMBNAIL_POINTER("/thumbnails/0/thumbnails/0/url");
+static const rapidjson::Pointer TOKEN_POINTER("/token");
+
+/**
+ * Where the values of each kind of renderer object are, indexed by Result::Type
+ */
+struct RendererLayout
+{
+    const char *key;                // member name of the renderer object
+    JsonPath idPath;                // videoId, playlistId or channelId
+    JsonPath thumbnailPath;
+    const rapidjson::Pointer *idPointer;
+    const rapidjson::Pointer *thumbnailPointer;
+};
+
+static const RendererLayout RENDERER_LAYOUTS[] = {
+    {"videoRenderer", jsonPath(VIDEO_ID_PATH), jsonPath(THUMBNAIL_PATH), &VIDEO_ID_POINTER, &THUMBNAIL_POINTER},
+    {"playlistRenderer", jsonPath(PLAYLIST_ID_PATH), jsonPath(PLAYLIST_THUMBNAIL_PATH), &PLAYLIST_ID_POINTER, &PLAYLIST_THUMBNAIL_POINTER},
+    {"channelRenderer", jsonPath(CHANNEL_ID_PATH), jsonPath(THUMBNAIL_PATH), &CHANNEL_ID_POINTER, &THUMBNAIL_POINTER},
+};
+
+static bool rendererType(const char *key, Result::Type &type)
+{
+    for (int i = 0; i < 3; ++i) {
+        if (!strcmp(key, RENDERER_LAYOUTS[i].key)) {
+            type = (Result::Type) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Values of one renderer object, as found by the SAX handler or in the DOM
+ */
+struct RendererFields
+{
+    Result::Type type;
+    string id;          // videoId, playlistId or channelId
+    string videoId;     // first video of a playlist
+    string title;
+    string thumbnail;
+
+    void reset(Result::Type rendererType)
+    {
+        type = rendererType;
+        id.clear();
+        videoId.clear();
+        title.clear();
+        thumbnail.clear();
+    }
+};
+
+static bool wantsId(const ScrapeOptions &options, Result::Type type)
+{
+    // the ID of a playlist is also the Result::playlist field
+    return options.hasField(FieldUrl) || (type == Result::Playlist && options.hasField(FieldTitle));
+}
+
+static void addRenderer(ResultList &results, const RendererFields &fields, const ScrapeOptions &options, ScrapeStats *stats)
+{
+    const bool wantUrl = options.hasField(FieldUrl);
+    const bool wantTitle = options.hasField(FieldTitle);
+    const bool isPlaylist = (fields.type == Result::Playlist);
+
+    if ((wantsId(options, fields.type) && fields.id.empty())
+            || (wantUrl && isPlaylist && fields.videoId.empty())
+            || (wantTitle && fields.title.empty())
+            || (options.hasField(FieldArtUrl) && fields.thumbnail.empty())) {
+        SCRAPE_LOG() << RENDERER_LAYOUTS[fields.type].key << " JSON element malformed";
+        if (stats)
+            stats->skippedItems++;
+        return;
+    }
+
+    Result result;
+    result.title = fields.title;
+    if (wantUrl) {
+        if (fields.type == Result::Video)
+            result.url = VIDEO_URL_PREFIX + fields.id;
+        else if (isPlaylist)
+            result.url = VIDEO_URL_PREFIX + fields.videoId + "&list=" + fields.id;
+        else
+            result.url = CHANNEL_URL_PREFIX + fields.id;
+    }
+    // channel thumbnails are protocol-relative
+    result.thumbnailUrl = (fields.thumbnail.compare(0, 2, "//") == 0) ? "https:" + fields.thumbnail : fields.thumbnail;
+    if (isPlaylist && wantTitle)
+        result.playlist = fields.id;
+    result.resultType = fields.type;
+    results.push_back(result);
+}
+
+/**
+ * SAX handler that picks videoRenderer, playlistRenderer and channelRenderer objects out of the
+ * ytInitialData JSON without building a DOM. A Result is emitted as soon as its renderer closes,
+ * and parsing is aborted once options.maxResults is reached, unless the token of the
+ * first continuationCommand is wanted as well.
+ */
+class SearchResultHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, SearchResultHandler>
+{
+public:
+    SearchResultHandler(ResultList &results, const ScrapeOptions &options, ScrapeStats *stats,
+                        const char *rootRenderer = nullptr, string *continuation = nullptr)
+        : m_results(results)
+        , m_options(options)
+        , m_wantUrl(options.hasField(FieldUrl))
+        , m_wantTitle(options.hasField(FieldTitle))
+        , m_wantThumbnail(options.hasField(FieldArtUrl))
+        , m_stats(stats)
+        , m_rootRenderer(rootRenderer)
+        , m_continuation(continuation)
+        , m_depth(0)
+        , m_rendererDepth(0)
+    {
+    }
+
+    bool StartObject() { return startContainer(false); }
+    bool StartArray() { return startContainer(true); }
+    bool EndObject(rapidjson::SizeType) { return endContainer(); }
+    bool EndArray(rapidjson::SizeType) { return endContainer(); }
+
+    bool Key(const char *str, rapidjson::SizeType length, bool)
+    {
+        m_frames[m_depth - 1].key.assign(str, length);
+        return true;
+    }
+
+    bool String(const char *str, rapidjson::SizeType length, bool)
+    {
+        if (m_rendererDepth > 0) {
+            string *value = isFull() ? nullptr : rendererValue();
+            if (value && value->empty())
+                value->assign(str, length);
+        }
+        else if (wantsContinuation() && isContinuationToken()) {
+            m_continuation->assign(str, length);
+            if (isFull())
+                return false;
+        }
+        return Default();
+    }
+
+    /**
+     * If true, the parser was stopped on purpose
+     */
+    bool isFull() const { return m_options.isFull(m_results.size()); }
+
+    // numbers, booleans and null
+    bool Default()
+    {
+        if (m_depth > 0)
+            m_frames[m_depth - 1].index++;
+        return true;
+    }
+
+private:
+    struct Frame
+    {
+        bool isArray;
+        rapidjson::SizeType index;
+        string key;
+    };
+
+    bool startContainer(bool isArray)
+    {
+        // a new renderer starts if its parent key matches and we're not already inside one. Once the
+        // results are full, renderers are still skipped as a whole, along with continuations inside them.
+        Result::Type type = Result::Video;
+        const bool isRenderer = !isArray && m_rendererDepth == 0 && (m_depth > 0
+                ? (!m_frames[m_depth - 1].isArray && rendererType(m_frames[m_depth - 1].key.c_str(), type))
+                : (m_rootRenderer && rendererType(m_rootRenderer, type)));
+
+        // frames are never popped from the vector, so that their key strings keep their capacity
+        if (m_frames.size() == m_depth)
+            m_frames.push_back(Frame());
+        Frame &frame = m_frames[m_depth++];
+        frame.isArray = isArray;
+        frame.index = 0;
+        frame.key.clear();
+
+        if (isRenderer) {
+            m_rendererDepth = m_depth;
+            m_fields.reset(type);
+        }
+        return true;
+    }
+
+    bool endContainer()
+    {
+        if (m_rendererDepth == m_depth) {
+            m_rendererDepth = 0;
+            if (!isFull()) {
+                addRenderer(m_results, m_fields, m_options, m_stats);
+                if (isFull() && !wantsContinuation())
+                    return false;
+            }
+        }
+        m_depth--;
+        return Default();
+    }
+
+    // the field that a string at the current position belongs to, if any
+    string *rendererValue()
+    {
+        const RendererLayout &layout = RENDERER_LAYOUTS[m_fields.type];
+        const bool isPlaylist = (m_fields.type == Result::Playlist);
+        if (wantsId(m_options, m_fields.type) && pathEquals(layout.idPath))
+            return &m_fields.id;
+        if (m_wantUrl && isPlaylist && pathEquals(jsonPath(PLAYLIST_VIDEO_ID_PATH)))
+            return &m_fields.videoId;
+        if (m_wantTitle && (pathEquals(jsonPath(TITLE_RUNS_PATH)) || pathEquals(jsonPath(TITLE_SIMPLE_PATH))))
+            return &m_fields.title;
+        if (m_wantThumbnail && pathEquals(layout.thumbnailPath))
+            return &m_fields.thumbnail;
+        return nullptr;
+    }
+
+    bool wantsContinuation() const
+    {
+        return m_continuation && m_continuation->empty();
+    }
+
+    bool isContinuationToken() const
+    {
+        return m_depth >= 2
+                && !m_frames[m_depth - 1].isArray && m_frames[m_depth - 1].key == "token"
+                && !m_frames[m_depth - 2].isArray && m_frames[m_depth - 2].key == "continuationCommand";
+    }
+
+    bool pathEquals(const JsonPath &path) const
+    {
+        if (m_depth - m_rendererDepth + 1 != path.length)
+            return false;
+        for (size_t i = 0; i < path.length; ++i) {
+            const Frame &frame = m_frames[m_rendererDepth - 1 + i];
+            const JsonPathElem &elem = path.elems[i];
+            if (elem.key ? (frame.isArray || frame.key != elem.key) : (!frame.isArray || frame.index != elem.index))
+                return false;
+        }
+        return true;
+    }
+
+    ResultList &m_results;
+    const ScrapeOptions m_options;
+    bool m_wantUrl;
+    bool m_wantTitle;
+    bool m_wantThumbnail;
+    ScrapeStats *m_stats;
+    const char *m_rootRenderer; // the parsed JSON is a single renderer object of this key
+    string *m_continuation;     // receives the continuation token, if wanted
+    vector<Frame> m_frames;
+    size_t m_depth;
+    size_t m_rendererDepth;
+    RendererFields m_fields;
+};
+
+/**
+ * Fast path: locate ytInitialData in the raw HTML and stream it through the SAX handler.
+ * Returns false if the data couldn't be found or parsed, in which case the DOM path is used.
+ */
+static bool searchResultSax(const char *html, size_t length, ResultList &ret,
+                            const ScrapeOptions &options, ScrapeStats *stats, string *continuation)
+{
+    ScrapeTimer findTimer(stats, &ScrapeStats::traversalNs);
+    const char *end = html + length;
+    const char *pos = memFind(html, end, YT_INITIAL_DATA, strlen(YT_INITIAL_DATA));
+    if (!pos) {
+        SCRAPE_LOG() << "No ytInitialData found in HTML";
+        return false;
+    }
+
+    findTimer.stop();
+
+    const char *json = pos + strlen(YT_INITIAL_DATA);
+    ScrapeTimer jsonTimer(stats, &ScrapeStats::jsonParseNs);
+    SearchResultHandler handler(ret, options, stats, nullptr, continuation);
+    rapidjson::MemoryStream stream(json, end - json);
+    rapidjson::Reader reader;
+    const rapidjson::ParseResult result = reader.Parse<rapidjson::kParseStopWhenDoneFlag>(stream, handler);
+    if (result.IsError() && !(result.Code() == rapidjson::kParseErrorTermination && handler.isFull())) {
+        SCRAPE_LOG() << "Error while parsing ytInitialData JSON: "
+                     << result.Code() << " (offset " << result.Offset() << ")";
+        ret.clear();
+        if (continuation)
+            continuation->clear();
+        return false;
+    }
+
+    return true;
+}
+
+static ResultList searchResultDom(const char *html, size_t length, ScrapeParser *parser,
+                                  const ScrapeOptions &options, ScrapeStats *stats, string *continuation)
+{
+    GumboOutput* output = ScrapeParserPrivate::parse(parser, html, length, stats);
+
+    ResultList ret;
+
+    // find <script> element with data
+    ScrapeTimer traversalTimer(stats, &ScrapeStats::traversalNs);
+    const vector<GumboNode*> scriptElements = gumboFind(output->root, GumboSelector(GUMBO_TAG_SCRIPT), true);
+    traversalTimer.stop();
+    for (GumboNode *scriptElem : scriptElements) {
+        if (options.isFull(ret.size()))
+            break;
+        const char *scriptText = gumboFindFirstText(scriptElem);
+        if (!scriptText)
+            continue;
+
+        const string text(scriptText);
+        const size_t pos = text.find(YT_INITIAL_DATA);
+        if (pos == string::npos)
+            continue;
+
+        const string jsonStr = text.substr(pos + strlen(YT_INITIAL_DATA));
+
+        ScrapeTimer jsonTimer(stats, &ScrapeStats::jsonParseNs);
+        rapidjson::Document json;
+        json.Parse<rapidjson::kParseStopWhenDoneFlag>(jsonStr.data());
+        jsonTimer.stop();
+        if (json.HasParseError()) {
+            SCRAPE_LOG() << "Error while parsing Trackinfo JSON: "
+                         << json.GetParseError() <<" (line " << json.GetErrorOffset() << ")";
+            continue;
+        }
+
+        // a single walk over the whole tree, for all kinds of renderers and the continuation
+        ScrapeTimer assemblyTimer(stats, &ScrapeStats::assemblyNs);
+        RendererFields fields;
+        auto visitor = [&](const char *name, const rapidjson::Value &value) -> JsonVisit {
+            const bool wantsContinuation = continuation && continuation->empty();
+            if (options.isFull(ret.size()) && !wantsContinuation)
+                return JsonStop;
+
+            Result::Type type;
+            if (rendererType(name, type)) {
+                if (!options.isFull(ret.size())) {
+                    fields.reset(type);
+                    const RendererLayout &layout = RENDERER_LAYOUTS[type];
+                    if (wantsId(options, type))
+                        jsonAssign(fields.id, layout.idPointer->Get(value));
+                    if (options.hasField(FieldUrl) && type == Result::Playlist)
+                        jsonAssign(fields.videoId, PLAYLIST_VIDEO_ID_POINTER.Get(value));
+                    if (options.hasField(FieldTitle)) {
+                        jsonAssign(fields.title, TITLE_RUNS_POINTER.Get(value));
+                        if (fields.title.empty())
+                            jsonAssign(fields.title, TITLE_SIMPLE_POINTER.Get(value));
+                    }
+                    if (options.hasField(FieldArtUrl))
+                        jsonAssign(fields.thumbnail, layout.thumbnailPointer->Get(value));
+                    addRenderer(ret, fields, options, stats);
+                }
+                return JsonSkip;
+            }
+
+            if (wantsContinuation && !strcmp(name, "continuationCommand")) {
+                jsonAssign(*continuation, TOKEN_POINTER.Get(value));
+                return JsonSkip;
+            }
+
+            return JsonDescend;
+        };
+        jsonVisitMembers(json, visitor);
+    }
+
+    ScrapeParserPrivate::destroy(parser, output);
+    return ret;
+}
+
+ResultList searchResult(const char *html, size_t length, ScrapeParser *parser, Continuation *continuation)
+{
+    ScrapeStats *stats = ScrapeParserPrivate::beginStats(parser, length);
+
+    const ScrapeOptions &options = ScrapeParserPrivate::optionsFor(parser);
+    string *token = nullptr;
+    if (continuation) {
+        *continuation = Continuation();
+        token = &continuation->token;
+    }
+
+    ResultList ret;
+    if (!options.fastPaths || !searchResultSax(html, length, ret, options, stats, token)) {
+        if (options.fastPaths && stats) {
+            // the DOM path runs into the same malformed items again
+            stats->skippedItems = 0;
+            stats->fallback = true;
+        }
+        ret = searchResultDom(html, length, parser, options, stats, token);
+    }
+
+    if (continuation && continuation->isValid()) {
+        ScrapeTimer configTimer(stats, &ScrapeStats::traversalNs);
+        continuation->apiKey = scanConfigString(html, length, INNERTUBE_API_KEY);
+        continuation->clientVersion = scanConfigString(html, length, INNERTUBE_CLIENT_VERSION);
+    }
+
+    if (stats)
+        stats->resultCount = ret.size();
+    return ret;
+}
+
+ResultList searchResult(const string &html, Continuation *continuation)
+{
+    return searchResult(html.data(), html.size(), nullptr, continuation);
+}
+
+ResultList continuationResult(const char *json, size_t length, ScrapeParser *parser, Continuation *continuation)
+{
+    ScrapeStats *stats = ScrapeParserPrivate::beginStats(parser, length);
+
+    const ScrapeOptions &options = ScrapeParserPrivate::optionsFor(parser);
+    string token;
+    ResultList ret;
+
+    ScrapeTimer jsonTimer(stats, &ScrapeStats::jsonParseNs);
+    SearchResultHandler handler(ret, options, stats, nullptr, continuation ? &token : nullptr);
+    rapidjson::MemoryStream stream(json, length);
+    rapidjson::Reader reader;
+    const rapidjson::ParseResult result = reader.Parse<rapidjson::kParseDefaultFlags>(stream, handler);
+    jsonTimer.stop();
+    if (result.IsError() && !(result.Code() == rapidjson::kParseErrorTermination && handler.isFull())) {
+        SCRAPE_LOG() << "Error while parsing continuation JSON: "
+                     << result.Code() << " (offset " << result.Offset() << ")";
+        if (stats)
+            stats->skippedItems++;
+        ret.clear();
+        token.clear();
+    }
+
+    if (continuation)
+        continuation->token = token;
+    if (stats)
+        stats->resultCount = ret.size();
+    return ret;
+}
+
+ResultList continuationResult(const string &json, Continuation *continuation)
+{
+    return continuationResult(json.data(), json.size(), nullptr, continuation);
+}
+
+/**
+ * Receives a single JSON string value
+ */
+class JsonStringHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, JsonStringHandler>
+{
+public:
+    JsonStringHandler(string &value) : m_value(value) {}
+
+    bool String(const char *str, rapidjson::SizeType length, bool)
+    {
+        m_value.assign(str, length);
+        return true;
+    }
+
+private:
+    string &m_value;
+};
+
+/**
+ * Follows the structure of ytInitialData as it arrives, without parsing it: string and escape state,
+ * and the keys of the objects that lead to the current position. Renderer objects and the
+ * continuation token are recognized at the same positions as SearchResultHandler does, renderers
+ * are parsed once their closing brace arrives.
+ */
+struct SearchResultStreamPrivate
+{
+    SearchResultStreamPrivate(ScrapeParser *parser)
+        : options(ScrapeParserPrivate::optionsFor(parser))
+        , dataState(BeforeData)
+        , scanPos(0)
+        , depth(0)
+        , objectStart(string::npos)
+        , objectDepth(0)
+        , stringStart(string::npos)
+        , inString(false)
+        , escaped(false)
+        , taken(0)
+    {
+        valueScans[0] = ValueScan{INNERTUBE_API_KEY, &continuation.apiKey, 0, false};
+        valueScans[1] = ValueScan{INNERTUBE_CLIENT_VERSION, &continuation.clientVersion, 0, false};
+    }
+
+    // a "key":"value" pair that is picked out of the raw stream
+    struct ValueScan
+    {
+        const char *key;
+        string *value;
+        size_t pos;         // where the search for key continues
+        bool found;
+    };
+
+    // an object or array of ytInitialData
+    struct Frame
+    {
+        bool isArray;
+        bool expectKey;     // the next string is a key
+        string key;         // the current key, outside of renderers
+    };
+
+    enum DataState
+    {
+        BeforeData,
+        InData,
+        AfterData
+    };
+
+    // looks for the values that are still missing, returns the start of the data that needs to be kept
+    size_t scanValues()
+    {
+        size_t keep = buffer.size();
+        for (ValueScan &scan : valueScans) {
+            if (scan.found)
+                continue;
+            const size_t keyLength = strlen(scan.key);
+            const size_t pos = buffer.find(scan.key, scan.pos);
+            if (pos == string::npos) {
+                if (buffer.size() >= keyLength)
+                    scan.pos = std::max(scan.pos, buffer.size() - keyLength + 1);
             }
             else {
-                SCRAPE_LOG() << "videoRenderer JSON element malformed";
+                const size_t valueEnd = buffer.find('"', pos + keyLength);
+                if (valueEnd != string::npos) {
+                    scan.value->assign(buffer, pos + keyLength, valueEnd - pos - keyLength);
+                    scan.found = true;
+                    continue;
+                }
+                scan.pos = pos;
+            }
+            keep = std::min(keep, scan.pos);
+        }
+        return keep;
+    }
+
+    // looks for the start of ytInitialData after scanPos
+    void findData()
+    {
+        const size_t keyLength = strlen(YT_INITIAL_DATA);
+        const size_t pos = buffer.find(YT_INITIAL_DATA, scanPos);
+        if (pos != string::npos) {
+            scanPos = pos + keyLength;
+            dataState = InData;
+        }
+        else if (buffer.size() >= keyLength) {
+            scanPos = std::max(scanPos, buffer.size() - keyLength + 1);
+        }
+    }
+
+    // continues the scan of ytInitialData up to the end of the buffer, or of ytInitialData
+    void scanData()
+    {
+        for (; scanPos < buffer.size() && dataState == InData; ++scanPos) {
+            const char c = buffer[scanPos];
+            if (inString) {
+                if (escaped) {
+                    escaped = false;
+                }
+                else if (c == '\\') {
+                    escaped = true;
+                }
+                else if (c == '"') {
+                    inString = false;
+                    endString();
+                }
+            }
+            else if (depth == 0 && c != '{') {
+                if (!isspace((unsigned char) c)) {
+                    SCRAPE_LOG() << "ytInitialData is not a JSON object";
+                    dataState = AfterData;
+                }
+            }
+            else if (c == '"') {
+                inString = true;
+                startString();
+            }
+            else if (c == '{' || c == '[') {
+                startContainer(c == '[');
+            }
+            else if (c == '}' || c == ']') {
+                endContainer();
+            }
+            else if (c == ':') {
+                frames[depth - 1].expectKey = false;
+            }
+            else if (c == ',') {
+                frames[depth - 1].expectKey = !frames[depth - 1].isArray;
             }
         }
+
+        if (dataState == AfterData)
+            scanPos = buffer.size();
     }
 
-    gumbo_destroy_output(&kGumboDefaultOptions, output);
+    // keys and the continuation token outside of renderers are kept until they are complete
+    void startString()
+    {
+        const bool wanted = frames[depth - 1].expectKey || (continuation.token.empty() && isContinuationToken());
+        stringStart = (objectDepth == 0 && wanted) ? scanPos : string::npos;
+    }
+
+    void endString()
+    {
+        if (stringStart == string::npos)
+            return;
+
+        Frame &frame = frames[depth - 1];
+        if (frame.expectKey) {
+            frame.key.assign(buffer, stringStart + 1, scanPos - stringStart - 1);
+        }
+        else {
+            // with its escapes resolved, as the SAX handler gets it
+            JsonStringHandler handler(continuation.token);
+            rapidjson::MemoryStream stream(buffer.data() + stringStart, scanPos + 1 - stringStart);
+            rapidjson::Reader reader;
+            if (reader.Parse<rapidjson::kParseDefaultFlags>(stream, handler).IsError())
+                SCRAPE_LOG() << "Malformed continuation token in ytInitialData JSON";
+            checkDone();
+        }
+        stringStart = string::npos;
+    }
+
+    // as in SearchResultHandler
+    bool isContinuationToken() const
+    {
+        return depth >= 2
+                && !frames[depth - 1].isArray && frames[depth - 1].key == "token"
+                && !frames[depth - 2].isArray && frames[depth - 2].key == "continuationCommand";
+    }
+
+    // the rest of ytInitialData isn't needed once the results and the token are there
+    void checkDone()
+    {
+        if (options.isFull(results.size()) && !continuation.token.empty())
+            dataState = AfterData;
+    }
+
+    void startContainer(bool isArray)
+    {
+        // a new renderer starts if its key matches and we're not already inside one. Once the results
+        // are full, renderers are only skipped.
+        Result::Type type = Result::Video;
+        if (!isArray && objectDepth == 0 && depth > 0
+                && !frames[depth - 1].isArray && rendererType(frames[depth - 1].key.c_str(), type)) {
+            objectStart = options.isFull(results.size()) ? string::npos : scanPos;
+            objectType = type;
+            objectDepth = depth + 1;
+        }
+
+        // frames are never popped from the vector, so that their key strings keep their capacity
+        if (frames.size() == depth)
+            frames.push_back(Frame());
+        Frame &frame = frames[depth++];
+        frame.isArray = isArray;
+        frame.expectKey = !isArray;
+        frame.key.clear();
+    }
+
+    void endContainer()
+    {
+        if (depth == objectDepth) {
+            if (objectStart != string::npos)
+                parseObject(objectStart, scanPos + 1);
+            objectStart = string::npos;
+            objectDepth = 0;
+            checkDone();
+        }
+        if (--depth == 0)
+            dataState = AfterData;
+    }
+
+    // the start of the data that the scan may still need
+    size_t scanKeep() const
+    {
+        size_t ret = scanPos;
+        if (objectStart != string::npos)
+            ret = std::min(ret, objectStart);
+        if (stringStart != string::npos)
+            ret = std::min(ret, stringStart);
+        return ret;
+    }
+
+    void parseObject(size_t begin, size_t end)
+    {
+        if (options.isFull(results.size()))
+            return;
+
+        SearchResultHandler handler(results, options, nullptr, RENDERER_LAYOUTS[objectType].key);
+        rapidjson::MemoryStream stream(buffer.data() + begin, end - begin);
+        rapidjson::Reader reader;
+        const rapidjson::ParseResult result = reader.Parse<rapidjson::kParseDefaultFlags>(stream, handler);
+        if (result.IsError() && !(result.Code() == rapidjson::kParseErrorTermination && handler.isFull())) {
+            SCRAPE_LOG() << "Error while parsing " << RENDERER_LAYOUTS[objectType].key << " JSON: "
+                         << result.Code() << " (offset " << result.Offset() << ")";
+        }
+    }
+
+    ScrapeOptions options;
+    string buffer;
+    DataState dataState;
+    size_t scanPos;
+    vector<Frame> frames;
+    size_t depth;
+    size_t objectStart;     // start of the current renderer object in buffer, if it's parsed
+    Result::Type objectType;
+    size_t objectDepth;     // depth of the current renderer object, 0 if outside of renderers
+    size_t stringStart;     // opening quote of the current string in buffer, if it's still needed
+    bool inString;
+    bool escaped;
+    ResultList results;
+    size_t taken;
+    Continuation continuation;
+    array<ValueScan, 2> valueScans;
+};
+
+SearchResultStream::SearchResultStream(ScrapeParser *parser)
+    : d(new SearchResultStreamPrivate(parser))
+{
+}
+
+SearchResultStream::~SearchResultStream()
+{
+    delete d;
+}
+
+void SearchResultStream::feed(const char *data, size_t length)
+{
+    d->buffer.append(data, length);
+    if (d->dataState == SearchResultStreamPrivate::BeforeData)
+        d->findData();
+    if (d->dataState == SearchResultStreamPrivate::InData)
+        d->scanData();
+
+    // drop everything before the current object or string, and before the values that are still looked for
+    const size_t keep = std::min(d->scanValues(), d->scanKeep());
+    d->buffer.erase(0, keep);
+    d->scanPos -= keep;
+    if (d->objectStart != string::npos)
+        d->objectStart -= keep;
+    if (d->stringStart != string::npos)
+        d->stringStart -= keep;
+    for (SearchResultStreamPrivate::ValueScan &scan : d->valueScans) {
+        if (!scan.found)
+            scan.pos -= keep;
+    }
+}
+
+void SearchResultStream::finish()
+{
+    if (d->dataState == SearchResultStreamPrivate::BeforeData)
+        SCRAPE_LOG() << "No ytInitialData found in HTML";
+
+    // an unterminated object at the end is malformed, and dropped
+    d->buffer.clear();
+    d->dataState = SearchResultStreamPrivate::AfterData;
+    d->scanPos = 0;
+    d->objectStart = string::npos;
+    d->stringStart = string::npos;
+
+    if (!d->continuation.isValid())
+        d->continuation = Continuation();
+}
+
+ResultList SearchResultStream::takeNewResults()
+{
+    const ResultList ret(d->results.begin() + d->taken, d->results.end());
+    d->taken = d->results.size();
     return ret;
 }
 
+const ResultList &SearchResultStream::results() const
+{
+    return d->results;
+}
+
+const Continuation &SearchResultStream::continuation() const
+{
+    return d->continuation;
+}
+
 } // namespace ScrapeYoutube
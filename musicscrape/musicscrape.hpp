@@ -21,13 +21,161 @@
 #ifndef INCLUDE_MUSICSCRAPE_HPP
 #define INCLUDE_MUSICSCRAPE_HPP
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
 /**
- * Set to true to print parsing errors on stderr
+ * Set to true to print parsing errors on stderr.
+ * All parsing functions can safely be called from multiple threads at once.
  */
-extern bool MUSIC_SCRAPE_LOG_ERRORS;
+extern std::atomic<bool> MUSIC_SCRAPE_LOG_ERRORS;
+
+struct ScrapeParserPrivate;
+
+/**
+ * Statistics of a single call to one of the parsing functions, see ScrapeParser::setCollectStats().
+ * The phase timings are wall-clock times in nanoseconds, and don't overlap.
+ */
+struct ScrapeStats
+{
+    size_t inputBytes;
+    uint64_t htmlParseNs;       // in gumbo_parse()
+    uint64_t traversalNs;       // searching the HTML tree for the relevant nodes
+    uint64_t jsonParseNs;       // in rapidjson, including the SAX extraction of YouTube results
+    uint64_t assemblyNs;        // building the Result objects
+    size_t nodeCount;           // number of nodes in the parsed HTML tree, 0 if the HTML wasn't parsed
+    size_t resultCount;
+    size_t skippedItems;        // items or pages that were dropped because they were malformed
+    bool fallback;              // the fast path failed and the page was parsed into a full tree
+};
+
+/**
+ * Result fields, for ScrapeOptions::fields
+ */
+enum ScrapeField
+{
+    FieldUrl        = 1 << 0,   // Bandcamp and YouTube url
+    FieldTitle      = 1 << 1,   // Bandcamp albumName and trackName, YouTube title and playlist ID
+    FieldBandName   = 1 << 2,   // Bandcamp bandName
+    FieldArtUrl     = 1 << 3,   // Bandcamp artUrl, YouTube thumbnailUrl
+    FieldMp3        = 1 << 4,   // Bandcamp mp3url and mp3duration
+    FieldTrackNum   = 1 << 5,   // Bandcamp trackNum
+    AllFields       = 0xff
+};
+
+/**
+ * HTML parsing backends, for ScrapeOptions::htmlBackend
+ */
+enum ScrapeHtmlBackend
+{
+    HtmlTree,           // Gumbo's full HTML5 parser, which builds a tree of the whole page
+    HtmlTokenizer       // Gumbo's tokenizer only, without a tree of the page. Needs the library to be built
+                        // with MUSICSCRAPE_TOKENIZER_BACKEND, falls back to HtmlTree otherwise
+};
+
+/**
+ * Limits the work done by the parsing functions, see ScrapeParser::setOptions()
+ */
+struct ScrapeOptions
+{
+    ScrapeOptions() : maxResults(0), fields(AllFields), fastPaths(true), htmlBackend(HtmlTree) {}
+
+    /**
+     * Parsing stops as soon as this many results were found, 0 for no limit
+     */
+    size_t maxResults;
+
+    /**
+     * Combination of ScrapeField values. Fields that are not included are left empty
+     * (or -1), and are neither looked up nor checked for validity.
+     */
+    unsigned fields;
+
+    /**
+     * Scan album pages and YouTube search pages directly, instead of parsing them into a full
+     * HTML tree. Whenever a page doesn't look as expected, the tree is built after all.
+     * Enabled by default, disable to always use the full parser, e.g. to compare results.
+     */
+    bool fastPaths;
+
+    /**
+     * ScrapeBandcamp::searchResult() and albumInfo() can run on the tokenizer alone, as a stream of
+     * tags and text, without building a tree. Misnested markup, which the tree construction would
+     * repair, may then be interpreted differently. The other functions always build the tree.
+     */
+    ScrapeHtmlBackend htmlBackend;
+
+    bool hasField(ScrapeField field) const { return (fields & field) != 0; }
+    bool isFull(size_t resultCount) const { return maxResults > 0 && resultCount >= maxResults; }
+};
+
+/**
+ * Reusable parsing context that can be passed to all parsing functions.
+ *
+ * All of Gumbo's allocations for a page are served from a bump-pointer arena, which is reset,
+ * but not freed, once the page is done. A warm parser therefore handles a stream of pages
+ * with next to no allocator traffic.
+ *
+ * A ScrapeParser must not be used by more than one thread at a time, use one instance per thread.
+ */
+class ScrapeParser
+{
+public:
+    ScrapeParser();
+    ~ScrapeParser();
+
+    /**
+     * Maximum number of parse errors that Gumbo records per page, -1 for no limit.
+     * None of the parsing functions look at these errors, so the default is 0.
+     */
+    void setMaxErrors(int maxErrors);
+    int maxErrors() const;
+
+    /**
+     * Memory currently held by the arena, in bytes
+     */
+    size_t arenaCapacity() const;
+
+    /**
+     * Total number of Gumbo allocations served by the arena, and of the heap allocations
+     * the arena itself needed to make for that
+     */
+    size_t arenaAllocations() const;
+    size_t heapAllocations() const;
+
+    /**
+     * Releases all memory held by the arena
+     */
+    void releaseMemory();
+
+    /**
+     * Options for all calls that are made with this parser
+     */
+    void setOptions(const ScrapeOptions &options);
+    const ScrapeOptions &options() const;
+
+    /**
+     * Enables collecting ScrapeStats for each call that is made with this parser. Disabled by
+     * default, in which case the parsing functions don't read the clock or count anything.
+     */
+    void setCollectStats(bool enabled);
+    bool collectStats() const;
+
+    /**
+     * Statistics of the most recent call, zeroed if collecting stats is disabled
+     */
+    const ScrapeStats &stats() const;
+
+private:
+    ScrapeParser(const ScrapeParser &) = delete;
+    ScrapeParser &operator=(const ScrapeParser &) = delete;
+
+    friend struct ScrapeParserPrivate;
+    ScrapeParserPrivate *d;
+};
 
 namespace ScrapeBandcamp {
 
@@ -79,11 +227,72 @@ struct Result
 
 using ResultList = std::vector<Result>;
 
+/**
+ * Kinds of results a search can be restricted to
+ */
+enum SearchItemType
+{
+    AllItems,
+    BandItems,
+    AlbumItems,
+    TrackItems
+};
+
 /**
  * Searches bandcamp
+ *
+ * A search page holds up to 18 results. Further pages are requested with page > 1, and
+ * searchResult() sets hasMorePages if the page links to a next one.
+ *
+ * All parsing functions also accept a (pointer, length) pair, so that the HTML can be parsed
+ * directly from a network or memory-mapped buffer. The buffer doesn't need to be NUL-terminated.
+ * An optional ScrapeParser can be passed in to re-use memory across calls.
  */
-std::string searchUrl(const std::string &pattern);
-ResultList searchResult(const std::string &html);
+std::string searchUrl(const std::string &pattern, SearchItemType itemType = AllItems, int page = 1);
+ResultList searchResult(const std::string &html, bool *hasMorePages = nullptr);
+ResultList searchResult(const char *html, size_t length, ScrapeParser *parser = nullptr,
+                        bool *hasMorePages = nullptr);
+
+struct SearchResultStreamPrivate;
+
+/**
+ * Incremental variant of searchResult(), for pages that arrive piece by piece. Each search
+ * result is parsed as soon as the next one starts, and the last one once finish() is called.
+ *
+ * The parser's ScrapeOptions at construction apply, except for htmlBackend: the search results
+ * are parsed one at a time, with the tokenizer if the library was built with it. The parser
+ * has to outlive the stream.
+ */
+class SearchResultStream
+{
+public:
+    SearchResultStream(ScrapeParser *parser = nullptr);
+    ~SearchResultStream();
+
+    void feed(const char *data, size_t length);
+    void finish();
+
+    /**
+     * Results that were found since the last call
+     */
+    ResultList takeNewResults();
+
+    /**
+     * All results found so far
+     */
+    const ResultList &results() const;
+
+    /**
+     * Whether the page links to a next one, once finish() was called
+     */
+    bool hasMorePages() const;
+
+private:
+    SearchResultStream(const SearchResultStream &) = delete;
+    SearchResultStream &operator=(const SearchResultStream &) = delete;
+
+    SearchResultStreamPrivate *d;
+};
 
 /**
  * For a given band URL (e.g. myband.bandcamp.com/),
@@ -91,12 +300,15 @@ ResultList searchResult(const std::string &html);
  */
 std::string bandInfoUrl(const std::string &bandUrl);
 ResultList bandInfoResult(const std::string &bandUrl, const std::string &html, bool *isSingleRelease = nullptr);
+ResultList bandInfoResult(const std::string &bandUrl, const char *html, size_t length,
+                          bool *isSingleRelease = nullptr, ScrapeParser *parser = nullptr);
 
 /**
  * For a given album URL (e.g. myband.bandcamp.com/album/myalbum),
  * return the list of streamable tracks on that album
  */
 ResultList albumInfo(const std::string &html);
+ResultList albumInfo(const char *html, size_t length, ScrapeParser *parser = nullptr);
 
 } // namespace ScrapeBandcamp
 
@@ -104,18 +316,23 @@ namespace ScrapeYoutube {
 
 struct Result
 {
+    enum Type { Video, Playlist, Channel };
+
     /**
      * Title as displayed on the search page
      */
     std::string title;
 
     /**
-     * Full URL to the video, e.g. https://www.youtube.com/watch?v=dQw4w9WgXcQ
+     * Full URL to the video, playlist or channel, e.g.
+     *      https://www.youtube.com/watch?v=dQw4w9WgXcQ, or
+     *      https://www.youtube.com/watch?v=VIDEO_ID&list=PLAYLIST_ID, or
+     *      https://www.youtube.com/channel/CHANNEL_ID
      */
     std::string url;
 
     /**
-     * URL to the video thumbnail
+     * URL to the video, playlist or channel thumbnail
      */
     std::string thumbnailUrl;
 
@@ -124,12 +341,88 @@ struct Result
      *      https://www.youtube.com/watch?v=VIDEO_ID&list=PLAYLIST_ID
      */
     std::string playlist;
+
+    /**
+     * Last member, so that {title, url, thumbnailUrl, playlist} initializers still yield a Video
+     */
+    Type resultType;
 };
 
 using ResultList = std::vector<Result>;
 
+/**
+ * Everything needed to request the next page of search results, as found on the previous page.
+ * Invalid on the last page.
+ */
+struct Continuation
+{
+    std::string token;
+    std::string apiKey;         // INNERTUBE_API_KEY of the search page
+    std::string clientVersion;  // INNERTUBE_CLIENT_VERSION of the search page
+
+    bool isValid() const { return !token.empty(); }
+};
+
+/**
+ * If continuation is given, it is filled in for the next page. With ScrapeOptions::maxResults,
+ * the whole ytInitialData is then still read, as the token comes after the videos.
+ */
 std::string searchUrl(const std::string &pattern);
-ResultList searchResult(const std::string &html);
+ResultList searchResult(const std::string &html, Continuation *continuation = nullptr);
+ResultList searchResult(const char *html, size_t length, ScrapeParser *parser = nullptr,
+                        Continuation *continuation = nullptr);
+
+/**
+ * Further pages of a search are requested by POSTing continuationBody() to continuationUrl().
+ * The response is a small JSON document instead of an HTML page.
+ *
+ * continuationResult() replaces the token with the one for the following page, or clears it
+ * on the last page. The API key and client version are kept, so that the same Continuation
+ * can be passed along for all pages of a search.
+ */
+std::string continuationUrl(const Continuation &continuation);
+std::string continuationBody(const Continuation &continuation);
+ResultList continuationResult(const std::string &json, Continuation *continuation = nullptr);
+ResultList continuationResult(const char *json, size_t length, ScrapeParser *parser = nullptr,
+                              Continuation *continuation = nullptr);
+
+struct SearchResultStreamPrivate;
+
+/**
+ * Incremental variant of searchResult(), for pages that arrive piece by piece.
+ * Each video, playlist or channel is extracted as soon as its JSON object is complete.
+ * The parser's ScrapeOptions at construction apply.
+ */
+class SearchResultStream
+{
+public:
+    SearchResultStream(ScrapeParser *parser = nullptr);
+    ~SearchResultStream();
+
+    void feed(const char *data, size_t length);
+    void finish();
+
+    /**
+     * Results that were found since the last call
+     */
+    ResultList takeNewResults();
+
+    /**
+     * All results found so far
+     */
+    const ResultList &results() const;
+
+    /**
+     * Continuation for the next page, once finish() was called and if the page had one
+     */
+    const Continuation &continuation() const;
+
+private:
+    SearchResultStream(const SearchResultStream &) = delete;
+    SearchResultStream &operator=(const SearchResultStream &) = delete;
+
+    SearchResultStreamPrivate *d;
+};
 
 } // namespace ScrapeYoutube
 
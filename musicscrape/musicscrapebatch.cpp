@@ -0,0 +1,268 @@
+// Copyright (c) 2020 Wieland Hagen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "musicscrapebatch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using std::vector;
+
+namespace ScrapeBatch {
+
+/**
+ * Shared state of one call to parse()
+ */
+struct Batch
+{
+    const Job *jobs;
+    const BatchParser::CompletionCallback *onCompleted;
+    const ScrapeOptions *options;
+    std::atomic<size_t> remaining;
+    std::atomic<bool> failed;
+    std::exception_ptr error;       // the first exception of a job, guarded by mutex
+    std::mutex mutex;
+    std::condition_variable finished;
+};
+
+struct Task
+{
+    Batch *batch;
+    size_t index;
+};
+
+struct Worker
+{
+    std::thread thread;
+    ScrapeParser parser;
+
+    // own tasks are taken from the front, stolen ones from the back
+    std::mutex mutex;
+    std::deque<Task> tasks;
+};
+
+struct BatchParserPrivate
+{
+    BatchParserPrivate(unsigned threadCount)
+        : pending(0)
+        , stop(false)
+        , nextWorker(0)
+    {
+        for (unsigned i = 0; i < threadCount; ++i)
+            workers.emplace_back(new Worker());
+        for (unsigned i = 0; i < threadCount; ++i)
+            workers[i]->thread = std::thread(&BatchParserPrivate::run, this, i);
+    }
+
+    ~BatchParserPrivate()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for (const std::unique_ptr<Worker> &worker : workers)
+            worker->thread.join();
+    }
+
+    void submit(Batch &batch, size_t count)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending += count;
+        }
+
+        // hand out contiguous chunks, starting with a different worker for each batch
+        const size_t workerCount = workers.size();
+        const size_t chunkSize = (count + workerCount - 1) / workerCount;
+        const size_t firstWorker = nextWorker++;
+        for (size_t i = 0; i < workerCount && i * chunkSize < count; ++i) {
+            Worker &worker = *workers[(firstWorker + i) % workerCount];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            for (size_t idx = i * chunkSize; idx < std::min(count, (i + 1) * chunkSize); ++idx)
+                worker.tasks.push_back(Task{&batch, idx});
+        }
+
+        wake.notify_all();
+    }
+
+    bool takeTask(size_t workerIndex, Task &task)
+    {
+        {
+            Worker &own = *workers[workerIndex];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = own.tasks.front();
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < workers.size(); ++i) {
+            Worker &victim = *workers[(workerIndex + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void run(size_t workerIndex)
+    {
+        Worker &worker = *workers[workerIndex];
+
+        while (true) {
+            Task task;
+            if (takeTask(workerIndex, task)) {
+                pending--;
+                execute(worker.parser, task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]() { return stop || pending > 0; });
+            if (stop)
+                return;
+        }
+    }
+
+    static void execute(ScrapeParser &parser, const Task &task)
+    {
+        // once a job failed, the rest of the batch is skipped
+        std::exception_ptr error;
+        if (!task.batch->failed) {
+            try {
+                parser.setOptions(*task.batch->options);
+                parseJob(parser, task);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+        // the batch may be gone as soon as the mutex is released after the last job
+        std::lock_guard<std::mutex> lock(task.batch->mutex);
+        if (error && !task.batch->failed) {
+            task.batch->error = error;
+            task.batch->failed = true;
+        }
+        if (--task.batch->remaining == 0)
+            task.batch->finished.notify_all();
+    }
+
+    static void parseJob(ScrapeParser &parser, const Task &task)
+    {
+        const Job &job = task.batch->jobs[task.index];
+
+        JobResult result;
+        result.kind = job.kind;
+        result.isSingleRelease = false;
+
+        switch (job.kind) {
+        case BandcampSearch:
+            result.bandcamp = ScrapeBandcamp::searchResult(job.html, job.length, &parser);
+            break;
+        case BandcampBandInfo:
+            result.bandcamp = ScrapeBandcamp::bandInfoResult(job.baseUrl, job.html, job.length,
+                                                             &result.isSingleRelease, &parser);
+            break;
+        case BandcampAlbum:
+            result.bandcamp = ScrapeBandcamp::albumInfo(job.html, job.length, &parser);
+            break;
+        case YoutubeSearch:
+            result.youtube = ScrapeYoutube::searchResult(job.html, job.length, &parser);
+            break;
+        }
+
+        (*task.batch->onCompleted)(task.index, result);
+    }
+
+    vector<std::unique_ptr<Worker>> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<size_t> pending;
+    bool stop;
+
+    std::atomic<size_t> nextWorker;
+};
+
+BatchParser::BatchParser(unsigned threadCount)
+    : d(new BatchParserPrivate(threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency())))
+{
+}
+
+BatchParser::~BatchParser()
+{
+    delete d;
+}
+
+unsigned BatchParser::threadCount() const
+{
+    return d->workers.size();
+}
+
+void BatchParser::parse(const Job *jobs, size_t count, const CompletionCallback &onCompleted,
+                        const ScrapeOptions &options)
+{
+    if (count == 0)
+        return;
+
+    Batch batch;
+    batch.jobs = jobs;
+    batch.onCompleted = &onCompleted;
+    batch.options = &options;
+    batch.remaining = count;
+    batch.failed = false;
+
+    d->submit(batch, count);
+
+    std::unique_lock<std::mutex> lock(batch.mutex);
+    batch.finished.wait(lock, [&]() { return batch.remaining == 0; });
+    if (batch.error)
+        std::rethrow_exception(batch.error);
+}
+
+vector<JobResult> BatchParser::parse(const Job *jobs, size_t count, const ScrapeOptions &options)
+{
+    vector<JobResult> ret(count);
+    parse(jobs, count, [&](size_t index, JobResult &result) {
+        ret[index] = std::move(result);
+    }, options);
+    return ret;
+}
+
+vector<JobResult> BatchParser::parse(const vector<Job> &jobs, const ScrapeOptions &options)
+{
+    return parse(jobs.data(), jobs.size(), options);
+}
+
+} // namespace ScrapeBatch
@@ -0,0 +1,110 @@
+// Copyright (c) 2020 Wieland Hagen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef INCLUDE_MUSICSCRAPEBATCH_HPP
+#define INCLUDE_MUSICSCRAPEBATCH_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "musicscrape/musicscrape.hpp"
+
+namespace ScrapeBatch {
+
+enum PageKind
+{
+    BandcampSearch,     // ScrapeBandcamp::searchResult()
+    BandcampBandInfo,   // ScrapeBandcamp::bandInfoResult(), needs baseUrl
+    BandcampAlbum,      // ScrapeBandcamp::albumInfo()
+    YoutubeSearch       // ScrapeYoutube::searchResult()
+};
+
+/**
+ * A single page to parse. The HTML buffer is not copied, and has to stay valid
+ * until the batch has been parsed.
+ */
+struct Job
+{
+    PageKind kind;
+    const char *html;
+    size_t length;
+    std::string baseUrl;
+};
+
+struct JobResult
+{
+    PageKind kind;
+    ScrapeBandcamp::ResultList bandcamp;    // for all Bandcamp page kinds
+    ScrapeYoutube::ResultList youtube;      // for YoutubeSearch
+    bool isSingleRelease;                   // for BandcampBandInfo
+};
+
+struct BatchParserPrivate;
+
+/**
+ * Parses many pages in parallel on a pool of worker threads.
+ *
+ * Each worker keeps its own ScrapeParser, so that memory stays warm across pages. Jobs of a batch
+ * are distributed evenly over the workers' queues, and idle workers steal jobs from busy ones.
+ * Batches may be submitted from several threads at once, they share the same workers.
+ */
+class BatchParser
+{
+public:
+    /**
+     * Starts the given number of worker threads, or one per hardware thread if 0
+     */
+    explicit BatchParser(unsigned threadCount = 0);
+    ~BatchParser();
+
+    unsigned threadCount() const;
+
+    /**
+     * Parses all jobs with the given options, and returns the results in input order.
+     * Blocks until the batch is done.
+     *
+     * If parsing a job throws, the jobs of the batch that haven't started yet are skipped, and
+     * the first exception is rethrown here once the batch is done.
+     */
+    std::vector<JobResult> parse(const Job *jobs, size_t count, const ScrapeOptions &options = ScrapeOptions());
+    std::vector<JobResult> parse(const std::vector<Job> &jobs, const ScrapeOptions &options = ScrapeOptions());
+
+    /**
+     * Parses all jobs, and calls onCompleted with the job's index for every finished job.
+     * The callback is called on the worker threads, in completion order.
+     * Blocks until the batch is done. Exceptions from the callback are handled like those
+     * of the parser.
+     */
+    using CompletionCallback = std::function<void(size_t index, JobResult &result)>;
+    void parse(const Job *jobs, size_t count, const CompletionCallback &onCompleted,
+               const ScrapeOptions &options = ScrapeOptions());
+
+private:
+    BatchParser(const BatchParser &) = delete;
+    BatchParser &operator=(const BatchParser &) = delete;
+
+    BatchParserPrivate *d;
+};
+
+} // namespace ScrapeBatch
+
+#endif // INCLUDE_MUSICSCRAPEBATCH_HPP
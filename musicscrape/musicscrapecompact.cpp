@@ -0,0 +1,192 @@
+// Copyright (c) 2020 Wieland Hagen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "musicscrapecompact.hpp"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+using std::string;
+
+namespace ScrapeBandcamp {
+
+static const StringRef EMPTY_REF = {0, 0};
+
+// FNV-1a
+static uint32_t strHash(const char *s, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char) s[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+CompactResultList::CompactResultList()
+    : m_internCount(0)
+{
+}
+
+CompactResultList::CompactResultList(const ResultList &results)
+    : m_internCount(0)
+{
+    append(results);
+}
+
+void CompactResultList::append(const Result &result)
+{
+    CompactResult compact;
+    compact.bandName = intern(result.bandName);
+    compact.albumName = intern(result.albumName);
+    compact.trackName = store(result.trackName);
+    compact.url = store(result.url);
+    compact.artUrl = intern(result.artUrl);
+    compact.mp3url = store(result.mp3url);
+    compact.trackNum = result.trackNum;
+    compact.mp3duration = result.mp3duration;
+    compact.resultType = result.resultType;
+    m_results.push_back(compact);
+}
+
+void CompactResultList::append(const ResultList &results)
+{
+    m_results.reserve(m_results.size() + results.size());
+    for (const Result &result : results)
+        append(result);
+}
+
+int CompactResultList::compare(StringRef a, StringRef b) const
+{
+    const int ret = memcmp(data(a), data(b), std::min(a.length, b.length));
+    if (ret != 0)
+        return ret;
+    return (a.length < b.length) ? -1 : (a.length > b.length) ? 1 : 0;
+}
+
+Result CompactResultList::result(size_t index) const
+{
+    const CompactResult &compact = m_results[index];
+    Result result;
+    result.resultType = compact.resultType;
+    result.bandName = str(compact.bandName);
+    result.albumName = str(compact.albumName);
+    result.trackName = str(compact.trackName);
+    result.trackNum = compact.trackNum;
+    result.url = str(compact.url);
+    result.artUrl = str(compact.artUrl);
+    result.mp3url = str(compact.mp3url);
+    result.mp3duration = compact.mp3duration;
+    return result;
+}
+
+ResultList CompactResultList::toResultList() const
+{
+    ResultList ret;
+    ret.reserve(m_results.size());
+    for (size_t i = 0; i < m_results.size(); ++i)
+        ret.push_back(result(i));
+    return ret;
+}
+
+void CompactResultList::reserve(size_t results, size_t arenaBytes)
+{
+    m_results.reserve(results);
+    m_arena.reserve(arenaBytes);
+}
+
+void CompactResultList::clear()
+{
+    m_results.clear();
+    m_arena.clear();
+    m_internTable.clear();
+    m_internCount = 0;
+}
+
+void CompactResultList::squeeze()
+{
+    std::vector<StringRef>().swap(m_internTable);
+    m_internCount = 0;
+    m_results.shrink_to_fit();
+    m_arena.shrink_to_fit();
+}
+
+size_t CompactResultList::memoryUsage() const
+{
+    return m_results.capacity() * sizeof(CompactResult)
+         + m_arena.capacity()
+         + m_internTable.capacity() * sizeof(StringRef);
+}
+
+StringRef CompactResultList::store(const string &s)
+{
+    if (s.empty())
+        return EMPTY_REF;
+
+    // offsets and lengths are 32 bits wide
+    const size_t maxArenaSize = std::numeric_limits<uint32_t>::max();
+    if (s.size() > maxArenaSize - m_arena.size())
+        throw std::length_error("CompactResultList: arena exceeds 4 GiB");
+
+    const StringRef ref = {(uint32_t) m_arena.size(), (uint32_t) s.size()};
+    m_arena.insert(m_arena.end(), s.begin(), s.end());
+    return ref;
+}
+
+StringRef CompactResultList::intern(const string &s)
+{
+    if (s.empty())
+        return EMPTY_REF;
+
+    // keep the load factor at or below 1/2
+    if (2 * (m_internCount + 1) > m_internTable.size())
+        growInternTable();
+
+    const size_t mask = m_internTable.size() - 1;
+    for (size_t slot = strHash(s.data(), s.size()) & mask; ; slot = (slot + 1) & mask) {
+        StringRef &entry = m_internTable[slot];
+        if (entry.length == 0) {
+            entry = store(s);
+            m_internCount++;
+            return entry;
+        }
+        if (entry.length == s.size() && !memcmp(data(entry), s.data(), s.size()))
+            return entry;
+    }
+}
+
+void CompactResultList::growInternTable()
+{
+    std::vector<StringRef> table(std::max<size_t>(16, 2 * m_internTable.size()), EMPTY_REF);
+    const size_t mask = table.size() - 1;
+    for (const StringRef &entry : m_internTable) {
+        if (entry.length == 0)
+            continue;
+        size_t slot = strHash(data(entry), entry.length) & mask;
+        while (table[slot].length != 0)
+            slot = (slot + 1) & mask;
+        table[slot] = entry;
+    }
+    m_internTable.swap(table);
+}
+
+} // namespace ScrapeBandcamp
@@ -0,0 +1,137 @@
+// Copyright (c) 2020 Wieland Hagen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INCLUDE_MUSICSCRAPECOMPACT_HPP
+#define INCLUDE_MUSICSCRAPECOMPACT_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "musicscrape/musicscrape.hpp"
+
+namespace ScrapeBandcamp {
+
+/**
+ * A string in the arena of a CompactResultList. The empty string is {0, 0}.
+ */
+struct StringRef
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+/**
+ * Same fields as Result, with all strings stored in the list's arena
+ */
+struct CompactResult
+{
+    StringRef bandName;
+    StringRef albumName;
+    StringRef trackName;
+    StringRef url;
+    StringRef artUrl;
+    StringRef mp3url;
+    int32_t trackNum;
+    int32_t mp3duration;
+    Result::Type resultType;
+};
+
+/**
+ * Memory-efficient alternative to ResultList, for keeping large numbers of results around.
+ *
+ * All strings live in one contiguous arena, and the results are plain structs that refer to
+ * them by offset. Band names, album names and art URLs, which are repeated for every track of
+ * an album or every release of a band, are interned and stored only once per list.
+ * The arena is limited to 4 GiB, append() throws std::length_error beyond that.
+ */
+class CompactResultList
+{
+public:
+    using const_iterator = std::vector<CompactResult>::const_iterator;
+
+    CompactResultList();
+    explicit CompactResultList(const ResultList &results);
+
+    void append(const Result &result);
+    void append(const ResultList &results);
+
+    size_t size() const { return m_results.size(); }
+    bool empty() const { return m_results.empty(); }
+    const CompactResult &operator[](size_t index) const { return m_results[index]; }
+    const_iterator begin() const { return m_results.begin(); }
+    const_iterator end() const { return m_results.end(); }
+
+    /**
+     * The string data is not NUL-terminated
+     */
+    const char *data(StringRef ref) const { return m_arena.data() + ref.offset; }
+    std::string str(StringRef ref) const { return std::string(data(ref), ref.length); }
+
+    /**
+     * Lexicographical comparison, as in std::string::compare()
+     */
+    int compare(StringRef a, StringRef b) const;
+
+    /**
+     * Conversion to the regular result types
+     */
+    Result result(size_t index) const;
+    ResultList toResultList() const;
+
+    /**
+     * Sorts the results by the given comparison of two CompactResults. Only the small
+     * result structs are moved, the arena stays as it is.
+     */
+    template <class Less>
+    void sort(const Less &less) { std::stable_sort(m_results.begin(), m_results.end(), less); }
+
+    void reserve(size_t results, size_t arenaBytes);
+    void clear();
+
+    /**
+     * Frees the hash table used for interning and any excess capacity. Strings that are
+     * appended afterwards are interned again only against each other.
+     */
+    void squeeze();
+
+    /**
+     * Heap memory held by this list, in bytes
+     */
+    size_t memoryUsage() const;
+    size_t arenaSize() const { return m_arena.size(); }
+
+private:
+    StringRef store(const std::string &s);
+    StringRef intern(const std::string &s);
+    void growInternTable();
+
+    std::vector<CompactResult> m_results;
+    std::vector<char> m_arena;
+
+    // open-addressing hash table of interned strings, empty slots have length 0
+    std::vector<StringRef> m_internTable;
+    size_t m_internCount;
+};
+
+} // namespace ScrapeBandcamp
+
+#endif // INCLUDE_MUSICSCRAPECOMPACT_HPP
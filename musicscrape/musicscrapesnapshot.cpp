@@ -0,0 +1,545 @@
+// Copyright (c) 2020 Wieland Hagen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "musicscrapesnapshot.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using std::string;
+using std::vector;
+
+namespace ScrapeSnapshot {
+
+static const char FILE_MAGIC[4] = {'M', 'S', 'S', 'N'};
+static const char BATCH_MAGIC[4] = {'M', 'S', 'B', 'T'};
+static const uint32_t FORMAT_VERSION = 2;
+
+static const size_t FILE_HEADER_SIZE = 16;      // magic, version, kind, reserved
+static const size_t BATCH_HEADER_SIZE = 16;     // magic, record count, blob size (64 bit)
+static const size_t STRING_REF_SIZE = 8;        // offset, length
+
+// record counts, and string offsets and lengths within the blob, are 32 bits wide
+static const size_t MAX_UINT32 = std::numeric_limits<uint32_t>::max();
+
+// 6 strings, trackNum, mp3duration, resultType, reserved
+static const size_t BANDCAMP_RECORD_SIZE = 6 * STRING_REF_SIZE + 4 * 4;
+// 4 strings, resultType, reserved
+static const size_t YOUTUBE_RECORD_SIZE = 4 * STRING_REF_SIZE + 2 * 4;
+
+static size_t recordSize(Kind kind)
+{
+    return (kind == Bandcamp) ? BANDCAMP_RECORD_SIZE : YOUTUBE_RECORD_SIZE;
+}
+
+static void putLE32(vector<char> &dst, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        dst.push_back((char) ((value >> (8 * i)) & 0xff));
+}
+
+static void putLE64(vector<char> &dst, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+        dst.push_back((char) ((value >> (8 * i)) & 0xff));
+}
+
+static uint32_t getLE32(const char *src)
+{
+    const unsigned char *s = (const unsigned char*) src;
+    return (uint32_t) s[0] | ((uint32_t) s[1] << 8) | ((uint32_t) s[2] << 16) | ((uint32_t) s[3] << 24);
+}
+
+static uint64_t getLE64(const char *src)
+{
+    return (uint64_t) getLE32(src) | ((uint64_t) getLE32(src + 4) << 32);
+}
+
+// 64-bit file positions, for snapshots larger than 2 GiB
+static bool fileSeek(FILE *file, uint64_t pos)
+{
+#ifdef _WIN32
+    return _fseeki64(file, (__int64) pos, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t) pos, SEEK_SET) == 0;
+#endif
+}
+
+static uint64_t fileSize(FILE *file)
+{
+#ifdef _WIN32
+    _fseeki64(file, 0, SEEK_END);
+    return (uint64_t) _ftelli64(file);
+#else
+    fseeko(file, 0, SEEK_END);
+    return (uint64_t) ftello(file);
+#endif
+}
+
+static bool checkFileHeader(const char *header, Kind *kind)
+{
+    if (memcmp(header, FILE_MAGIC, 4) || getLE32(header + 4) != FORMAT_VERSION)
+        return false;
+    const uint32_t k = getLE32(header + 8);
+    if (k != Bandcamp && k != Youtube)
+        return false;
+    *kind = (Kind) k;
+    return true;
+}
+
+/**
+ * Returns the size of the batch starting at header, or 0 if it's incomplete or malformed
+ */
+static uint64_t batchSize(const char *header, uint64_t available, Kind kind, uint32_t *recordCount)
+{
+    if (available < BATCH_HEADER_SIZE || memcmp(header, BATCH_MAGIC, 4))
+        return 0;
+    *recordCount = getLE32(header + 4);
+    const uint64_t blobSize = getLE64(header + 8);
+    const uint64_t tableSize = (uint64_t) *recordCount * recordSize(kind);
+    if (tableSize > available - BATCH_HEADER_SIZE || blobSize > available - BATCH_HEADER_SIZE - tableSize)
+        return 0;
+    return BATCH_HEADER_SIZE + tableSize + blobSize;
+}
+
+/**
+ * Builds the string blob of one batch. Strings that would end beyond 4 GiB are stored as empty
+ * strings, and set overflow.
+ */
+class BlobBuilder
+{
+public:
+    BlobBuilder() : overflow(false) {}
+
+    vector<char> blob;
+    bool overflow;
+
+    void add(vector<char> &record, const string &s)
+    {
+        if (!fits(record, s))
+            return;
+        putLE32(record, (uint32_t) blob.size());
+        putLE32(record, (uint32_t) s.size());
+        blob.insert(blob.end(), s.begin(), s.end());
+    }
+
+    // for strings that are likely to repeat within a batch
+    void addShared(vector<char> &record, const string &s)
+    {
+        auto it = m_shared.find(s);
+        if (it == m_shared.end()) {
+            if (!fits(record, s))
+                return;
+            it = m_shared.insert(std::make_pair(s, (uint32_t) blob.size())).first;
+            blob.insert(blob.end(), s.begin(), s.end());
+        }
+        putLE32(record, it->second);
+        putLE32(record, (uint32_t) s.size());
+    }
+
+private:
+    bool fits(vector<char> &record, const string &s)
+    {
+        if (s.size() <= MAX_UINT32 - blob.size())
+            return true;
+        overflow = true;
+        putLE32(record, 0);
+        putLE32(record, 0);
+        return false;
+    }
+
+    std::unordered_map<string, uint32_t> m_shared;
+};
+
+ScrapeBandcamp::Result BandcampRecord::toResult() const
+{
+    ScrapeBandcamp::Result result;
+    result.resultType = resultType;
+    result.bandName = bandName.str();
+    result.albumName = albumName.str();
+    result.trackName = trackName.str();
+    result.trackNum = trackNum;
+    result.url = url.str();
+    result.artUrl = artUrl.str();
+    result.mp3url = mp3url.str();
+    result.mp3duration = mp3duration;
+    return result;
+}
+
+ScrapeYoutube::Result YoutubeRecord::toResult() const
+{
+    return ScrapeYoutube::Result{title.str(), url.str(), thumbnailUrl.str(), playlist.str(), resultType};
+}
+
+Writer::Writer()
+    : m_file(nullptr)
+    , m_kind(Bandcamp)
+{
+}
+
+Writer::~Writer()
+{
+    close();
+}
+
+bool Writer::open(const string &path, Kind kind)
+{
+    close();
+    m_kind = kind;
+    m_error.clear();
+
+    // check the existing file, and find the end of its last complete batch
+    uint64_t validEnd = 0;
+    uint64_t existingSize = 0;
+    if (FILE *existing = fopen(path.c_str(), "rb")) {
+        existingSize = fileSize(existing);
+        fileSeek(existing, 0);
+
+        char header[FILE_HEADER_SIZE];
+        Kind existingKind;
+        if (existingSize > 0) {
+            if (existingSize < FILE_HEADER_SIZE || fread(header, 1, FILE_HEADER_SIZE, existing) != FILE_HEADER_SIZE
+                    || !checkFileHeader(header, &existingKind) || existingKind != kind) {
+                fclose(existing);
+                return fail(path + " is not a snapshot of the requested kind");
+            }
+            validEnd = FILE_HEADER_SIZE;
+
+            char batchHeader[BATCH_HEADER_SIZE];
+            while (fileSeek(existing, validEnd)
+                   && fread(batchHeader, 1, BATCH_HEADER_SIZE, existing) == BATCH_HEADER_SIZE) {
+                uint32_t recordCount;
+                const uint64_t size = batchSize(batchHeader, existingSize - validEnd, kind, &recordCount);
+                if (size == 0)
+                    break;
+                validEnd += size;
+            }
+        }
+        fclose(existing);
+    }
+
+    // drop a batch that was cut off, so that new batches are found by the reader
+    if (validEnd < existingSize) {
+#ifdef _WIN32
+        return fail(path + " ends with an incomplete batch");
+#else
+        if (truncate(path.c_str(), (off_t) validEnd) != 0)
+            return fail("Can't truncate " + path);
+#endif
+    }
+
+    m_file = fopen(path.c_str(), "ab");
+    if (!m_file)
+        return fail("Can't open " + path + " for writing");
+
+    if (validEnd == 0) {
+        vector<char> header(FILE_MAGIC, FILE_MAGIC + 4);
+        putLE32(header, FORMAT_VERSION);
+        putLE32(header, kind);
+        putLE32(header, 0);
+        if (fwrite(header.data(), 1, header.size(), m_file) != header.size() || fflush(m_file) != 0)
+            return fail("Can't write to " + path);
+    }
+
+    return true;
+}
+
+void Writer::close()
+{
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+bool Writer::append(const ScrapeBandcamp::ResultList &results)
+{
+    if (!m_file || m_kind != Bandcamp)
+        return fail("Snapshot is not open for Bandcamp results");
+    if (results.empty())
+        return true;
+    if (results.size() > MAX_UINT32)
+        return fail("Too many results for a single snapshot batch");
+
+    vector<char> records;
+    records.reserve(results.size() * BANDCAMP_RECORD_SIZE);
+    BlobBuilder blob;
+    for (const ScrapeBandcamp::Result &result : results) {
+        blob.addShared(records, result.bandName);
+        blob.addShared(records, result.albumName);
+        blob.add(records, result.trackName);
+        blob.add(records, result.url);
+        blob.addShared(records, result.artUrl);
+        blob.add(records, result.mp3url);
+        putLE32(records, (uint32_t) result.trackNum);
+        putLE32(records, (uint32_t) result.mp3duration);
+        putLE32(records, (uint32_t) result.resultType);
+        putLE32(records, 0);
+    }
+
+    if (blob.overflow)
+        return fail("Strings of a single snapshot batch exceed 4 GiB");
+    return writeBatch((uint32_t) results.size(), records, blob.blob);
+}
+
+bool Writer::append(const ScrapeYoutube::ResultList &results)
+{
+    if (!m_file || m_kind != Youtube)
+        return fail("Snapshot is not open for YouTube results");
+    if (results.empty())
+        return true;
+    if (results.size() > MAX_UINT32)
+        return fail("Too many results for a single snapshot batch");
+
+    vector<char> records;
+    records.reserve(results.size() * YOUTUBE_RECORD_SIZE);
+    BlobBuilder blob;
+    for (const ScrapeYoutube::Result &result : results) {
+        blob.add(records, result.title);
+        blob.add(records, result.url);
+        blob.add(records, result.thumbnailUrl);
+        blob.addShared(records, result.playlist);
+        putLE32(records, (uint32_t) result.resultType);
+        putLE32(records, 0);
+    }
+
+    if (blob.overflow)
+        return fail("Strings of a single snapshot batch exceed 4 GiB");
+    return writeBatch((uint32_t) results.size(), records, blob.blob);
+}
+
+bool Writer::writeBatch(uint32_t recordCount, const vector<char> &records, const vector<char> &blob)
+{
+    vector<char> header(BATCH_MAGIC, BATCH_MAGIC + 4);
+    putLE32(header, recordCount);
+    putLE64(header, blob.size());
+
+    if (fwrite(header.data(), 1, header.size(), m_file) != header.size()
+            || fwrite(records.data(), 1, records.size(), m_file) != records.size()
+            || fwrite(blob.data(), 1, blob.size(), m_file) != blob.size()
+            || fflush(m_file) != 0) {
+        return fail("Error while writing snapshot batch");
+    }
+    return true;
+}
+
+bool Writer::fail(const string &error)
+{
+    m_error = error;
+    return false;
+}
+
+Reader::Reader()
+    : m_data(nullptr)
+    , m_length(0)
+    , m_kind(Bandcamp)
+    , m_size(0)
+{
+}
+
+Reader::~Reader()
+{
+    close();
+}
+
+bool Reader::open(const string &path)
+{
+    close();
+    m_error.clear();
+
+#ifdef _WIN32
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return fail("Can't open " + path);
+    m_buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (m_buffer.empty())
+        return fail(path + " is empty");
+    m_data = m_buffer.data();
+    m_length = m_buffer.size();
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return fail("Can't open " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return fail(path + " is empty");
+    }
+    void *mapping = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return fail("Can't map " + path);
+    m_data = (const char*) mapping;
+    m_length = (size_t) st.st_size;
+#endif
+
+    if (m_length < FILE_HEADER_SIZE || !checkFileHeader(m_data, &m_kind)) {
+        close();
+        return fail(path + " is not a snapshot");
+    }
+
+    // index the batches, records are only touched on access
+    const size_t recSize = recordSize(m_kind);
+    size_t pos = FILE_HEADER_SIZE;
+    while (pos < m_length) {
+        // batchSize() checks that the record table and the blob lie within the file
+        uint32_t recordCount;
+        const uint64_t size = batchSize(m_data + pos, m_length - pos, m_kind, &recordCount);
+        if (size == 0)
+            break;
+        if (recordCount > 0) {
+            Batch batch;
+            batch.firstIndex = m_size;
+            batch.records = m_data + pos + BATCH_HEADER_SIZE;
+            batch.blob = batch.records + (size_t) recordCount * recSize;
+            batch.blobSize = getLE64(m_data + pos + 8);
+            m_batches.push_back(batch);
+            m_size += recordCount;
+        }
+        pos += size;
+    }
+
+    return true;
+}
+
+void Reader::close()
+{
+#ifndef _WIN32
+    if (m_data)
+        munmap((void*) m_data, m_length);
+#endif
+    m_data = nullptr;
+    m_length = 0;
+    vector<char>().swap(m_buffer);
+    m_size = 0;
+    m_batches.clear();
+}
+
+const char *Reader::record(size_t index, size_t recSize, const Batch **batch) const
+{
+    // out of range, or records of the other kind
+    if (index >= m_size || recSize != recordSize(m_kind))
+        return nullptr;
+
+    auto it = std::upper_bound(m_batches.begin(), m_batches.end(), index, [](size_t idx, const Batch &b) {
+        return idx < b.firstIndex;
+    });
+    *batch = &*(it - 1);
+    return (*batch)->records + (index - (*batch)->firstIndex) * recSize;
+}
+
+StringView Reader::stringAt(const Batch &batch, const char *ref) const
+{
+    const uint32_t offset = getLE32(ref);
+    const uint32_t length = getLE32(ref + 4);
+    if ((uint64_t) offset + length > batch.blobSize)
+        return StringView{"", 0};
+    return StringView{batch.blob + offset, length};
+}
+
+BandcampRecord Reader::bandcamp(size_t index) const
+{
+    const Batch *batch;
+    const char *rec = record(index, BANDCAMP_RECORD_SIZE, &batch);
+
+    BandcampRecord ret;
+    if (!rec) {
+        ret.resultType = ScrapeBandcamp::Result::Track;
+        ret.bandName = ret.albumName = ret.trackName = ret.url = ret.artUrl = ret.mp3url = StringView{"", 0};
+        ret.trackNum = -1;
+        ret.mp3duration = -1;
+        return ret;
+    }
+    ret.bandName = stringAt(*batch, rec);
+    ret.albumName = stringAt(*batch, rec + 8);
+    ret.trackName = stringAt(*batch, rec + 16);
+    ret.url = stringAt(*batch, rec + 24);
+    ret.artUrl = stringAt(*batch, rec + 32);
+    ret.mp3url = stringAt(*batch, rec + 40);
+    ret.trackNum = (int32_t) getLE32(rec + 48);
+    ret.mp3duration = (int32_t) getLE32(rec + 52);
+    const uint32_t type = getLE32(rec + 56);
+    ret.resultType = (type <= ScrapeBandcamp::Result::Track) ? (ScrapeBandcamp::Result::Type) type
+                                                             : ScrapeBandcamp::Result::Track;
+    return ret;
+}
+
+YoutubeRecord Reader::youtube(size_t index) const
+{
+    const Batch *batch;
+    const char *rec = record(index, YOUTUBE_RECORD_SIZE, &batch);
+
+    YoutubeRecord ret;
+    if (!rec) {
+        ret.resultType = ScrapeYoutube::Result::Video;
+        ret.title = ret.url = ret.thumbnailUrl = ret.playlist = StringView{"", 0};
+        return ret;
+    }
+    ret.title = stringAt(*batch, rec);
+    ret.url = stringAt(*batch, rec + 8);
+    ret.thumbnailUrl = stringAt(*batch, rec + 16);
+    ret.playlist = stringAt(*batch, rec + 24);
+    const uint32_t type = getLE32(rec + 32);
+    ret.resultType = (type <= ScrapeYoutube::Result::Channel) ? (ScrapeYoutube::Result::Type) type
+                                                              : ScrapeYoutube::Result::Video;
+    return ret;
+}
+
+ScrapeBandcamp::ResultList Reader::bandcampResults() const
+{
+    ScrapeBandcamp::ResultList ret;
+    if (m_kind != Bandcamp)
+        return ret;
+    ret.reserve(m_size);
+    for (size_t i = 0; i < m_size; ++i)
+        ret.push_back(bandcamp(i).toResult());
+    return ret;
+}
+
+ScrapeYoutube::ResultList Reader::youtubeResults() const
+{
+    ScrapeYoutube::ResultList ret;
+    if (m_kind != Youtube)
+        return ret;
+    ret.reserve(m_size);
+    for (size_t i = 0; i < m_size; ++i)
+        ret.push_back(youtube(i).toResult());
+    return ret;
+}
+
+bool Reader::fail(const string &error)
+{
+    m_error = error;
+    return false;
+}
+
+} // namespace ScrapeSnapshot
@@ -0,0 +1,182 @@
+// Copyright (c) 2020 Wieland Hagen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INCLUDE_MUSICSCRAPESNAPSHOT_HPP
+#define INCLUDE_MUSICSCRAPESNAPSHOT_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "musicscrape/musicscrape.hpp"
+
+/**
+ * Binary snapshot files for result lists, which can be memory-mapped and read in place.
+ *
+ * A snapshot starts with a 16-byte header (magic "MSSN", format version, kind), followed by any
+ * number of batches. Each batch holds a table of fixed-size records and a blob with the strings
+ * the records refer to by (offset, length). All integers are little-endian, regardless of the
+ * platform. A batch that was cut off by a crash is ignored by the reader.
+ */
+namespace ScrapeSnapshot {
+
+enum Kind
+{
+    Bandcamp = 1,
+    Youtube = 2
+};
+
+/**
+ * String in a mapped snapshot, not NUL-terminated
+ */
+struct StringView
+{
+    const char *data;
+    size_t length;
+
+    std::string str() const { return std::string(data, length); }
+};
+
+struct BandcampRecord
+{
+    ScrapeBandcamp::Result::Type resultType;
+    StringView bandName;
+    StringView albumName;
+    StringView trackName;
+    int trackNum;
+    StringView url;
+    StringView artUrl;
+    StringView mp3url;
+    int mp3duration;
+
+    ScrapeBandcamp::Result toResult() const;
+};
+
+struct YoutubeRecord
+{
+    ScrapeYoutube::Result::Type resultType;
+    StringView title;
+    StringView url;
+    StringView thumbnailUrl;
+    StringView playlist;
+
+    ScrapeYoutube::Result toResult() const;
+};
+
+/**
+ * Appends batches of results to a snapshot file
+ */
+class Writer
+{
+public:
+    Writer();
+    ~Writer();
+
+    /**
+     * Opens the file for appending, and creates it if it doesn't exist yet.
+     * Fails if the file exists, but is not a snapshot of the given kind.
+     */
+    bool open(const std::string &path, Kind kind);
+    void close();
+    bool isOpen() const { return m_file != nullptr; }
+
+    /**
+     * Writes the results as one batch. Strings that repeat within the batch are stored once.
+     * Fails without writing anything if the batch has more than 2^32 - 1 results, or 4 GiB of strings.
+     */
+    bool append(const ScrapeBandcamp::ResultList &results);
+    bool append(const ScrapeYoutube::ResultList &results);
+
+    const std::string &errorString() const { return m_error; }
+
+private:
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    bool writeBatch(uint32_t recordCount, const std::vector<char> &records, const std::vector<char> &blob);
+    bool fail(const std::string &error);
+
+    FILE *m_file;
+    Kind m_kind;
+    std::string m_error;
+};
+
+/**
+ * Memory-maps a snapshot file. Opening only walks the batch headers, records are decoded
+ * on access. Record views point into the mapping, and stay valid until close().
+ */
+class Reader
+{
+public:
+    Reader();
+    ~Reader();
+
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+
+    Kind kind() const { return m_kind; }
+    size_t size() const { return m_size; }
+    size_t batchCount() const { return m_batches.size(); }
+
+    /**
+     * Record access, for snapshots of the matching kind. An index past size(), or a record of
+     * the other kind, yields a record with empty strings.
+     */
+    BandcampRecord bandcamp(size_t index) const;
+    YoutubeRecord youtube(size_t index) const;
+
+    /**
+     * Decodes all records
+     */
+    ScrapeBandcamp::ResultList bandcampResults() const;
+    ScrapeYoutube::ResultList youtubeResults() const;
+
+    const std::string &errorString() const { return m_error; }
+
+private:
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    struct Batch
+    {
+        size_t firstIndex;
+        const char *records;
+        const char *blob;
+        uint64_t blobSize;
+    };
+
+    const char *record(size_t index, size_t recordSize, const Batch **batch) const;
+    StringView stringAt(const Batch &batch, const char *ref) const;
+    bool fail(const std::string &error);
+
+    const char *m_data;
+    size_t m_length;
+    std::vector<char> m_buffer;     // file contents, where mmap() is not available
+    Kind m_kind;
+    size_t m_size;
+    std::vector<Batch> m_batches;
+    std::string m_error;
+};
+
+} // namespace ScrapeSnapshot
+
+#endif // INCLUDE_MUSICSCRAPESNAPSHOT_HPP
@@ -22,97 +22,1288 @@
 
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QDateTime>
+#include <QLocale>
+#include <QTimer>
 
+#include <climits>
+
+/**
+ * Parses one downloaded page on a pool thread, and hands the result back to the QMusicScrape
+ */
+class QMusicScrape::ParseTask : public QRunnable
+{
+public:
+    ParseTask(QMusicScrape *owner, const Completion &completion, const QByteArray &data, const std::string &url)
+        : m_owner(owner)
+        , m_completion(completion)
+        , m_data(data)
+        , m_url(url)
+    {
+    }
+
+    void run() override
+    {
+        // pool threads are long-lived, so each of them keeps its warm arena between pages
+        static thread_local ScrapeParser parser;
+        QMusicScrape::parse(m_completion, m_data, m_url, &parser);
+        m_data.clear();
+        m_owner->finishParse(m_completion);
+    }
+
+private:
+    QMusicScrape *m_owner;
+    Completion m_completion;
+    QByteArray m_data;
+    std::string m_url;
+};
 
 QMusicScrape::QMusicScrape(QObject *parent)
     : QObject(parent)
     , m_network(new QNetworkAccessManager(this))
     , m_nextRequestId(1)
+    , m_threadPool(QThreadPool::globalInstance())
+    , m_resultOrder(CompletionOrder)
+    , m_cache(nullptr)
+    , m_parsesInFlight(0)
+    , m_discographyConcurrency(4)
+    , m_defaultMaxConnections(4)
+    , m_adaptiveRateControl(true)
+    , m_maxRetries(5)
+    , m_streaming(false)
+    , m_maxResults(0)
 {
+    m_cacheTtl[BandcampSearch] = 10 * 60;
+    m_cacheTtl[BandcampArtistInfo] = 60 * 60;
+    m_cacheTtl[BandcampAlbumInfo] = 24 * 60 * 60;
+    m_cacheTtl[YoutubeSearch] = 10 * 60;
+    m_cacheTtl[YoutubeNextPage] = 0;
+
+    m_clock.start();
+    resetSchedulerStats();
+    resetPrefetchStats();
+
     qRegisterMetaType<ScrapeBandcamp::ResultList>();
     qRegisterMetaType<ScrapeYoutube::ResultList>();
+    qRegisterMetaType<ScrapeYoutube::Continuation>();
 
     connect(m_network, &QNetworkAccessManager::finished, this, &QMusicScrape::onNetworkReplyFinished);
 }
 
 QMusicScrape::~QMusicScrape()
 {
-    for (const RunningRequest &request : m_runningHttpRequests) {
+    for (const PendingRequest &request : m_pendingRequests) {
         if (request.m_reply)
             request.m_reply->deleteLater();
     }
+
+    // parse tasks hold a pointer to us, wait for them to finish
+    QMutexLocker lock(&m_parseMutex);
+    while (m_parsesInFlight > 0)
+        m_parseDone.wait(&m_parseMutex);
+}
+
+void QMusicScrape::setThreadPool(QThreadPool *threadPool)
+{
+    m_threadPool = threadPool;
+}
+
+QThreadPool *QMusicScrape::threadPool() const
+{
+    return m_threadPool;
+}
+
+void QMusicScrape::setNetworkAccessManager(QNetworkAccessManager *network)
+{
+    if (network == m_network)
+        return;
+
+    // the default one is ours
+    if (m_network->parent() == this)
+        delete m_network;
+    else
+        disconnect(m_network, nullptr, this, nullptr);
+
+    m_network = network;
+    connect(m_network, &QNetworkAccessManager::finished, this, &QMusicScrape::onNetworkReplyFinished);
+}
+
+QNetworkAccessManager *QMusicScrape::networkAccessManager() const
+{
+    return m_network;
+}
+
+void QMusicScrape::setResultOrder(QMusicScrape::ResultOrder order)
+{
+    m_resultOrder = order;
+
+    // release everything that was held back for RequestOrder
+    if (order == CompletionOrder) {
+        const QMap<RequestId, QSharedPointer<const Completion>> heldBack = m_heldBack;
+        m_heldBack.clear();
+        for (auto it = heldBack.begin(); it != heldBack.end(); ++it)
+            emitCompletion(it.key(), *it.value());
+    }
+}
+
+QMusicScrape::ResultOrder QMusicScrape::resultOrder() const
+{
+    return m_resultOrder;
+}
+
+void QMusicScrape::setCache(QMusicScrapeCache *cache)
+{
+    m_cache = cache;
 }
 
-QMusicScrape::RequestId QMusicScrape::startRequest(QMusicScrape::RequestType requestType, const std::string &url)
+QMusicScrapeCache *QMusicScrape::cache() const
 {
-    RunningRequest request;
-    request.m_id = m_nextRequestId++;
+    return m_cache;
+}
+
+void QMusicScrape::setCacheTtl(QMusicScrape::RequestType type, int seconds)
+{
+    Q_ASSERT(type >= 0 && type < RequestTypeCount);
+    m_cacheTtl[type] = seconds;
+}
+
+int QMusicScrape::cacheTtl(QMusicScrape::RequestType type) const
+{
+    Q_ASSERT(type >= 0 && type < RequestTypeCount);
+    return m_cacheTtl[type];
+}
+
+void QMusicScrape::setMaxConnectionsPerHost(int connections)
+{
+    m_defaultMaxConnections = qMax(1, connections);
+    for (const QString &host : m_hosts.keys())
+        schedule(host);
+}
+
+void QMusicScrape::setMaxConnectionsPerHost(const QString &host, int connections)
+{
+    m_maxConnections[host] = qMax(1, connections);
+    schedule(host);
+}
+
+int QMusicScrape::maxConnectionsPerHost(const QString &host) const
+{
+    return m_maxConnections.value(host, m_defaultMaxConnections);
+}
+
+void QMusicScrape::setAdaptiveRateControl(bool enabled)
+{
+    m_adaptiveRateControl = enabled;
+    for (const QString &host : m_hosts.keys())
+        schedule(host);
+}
+
+bool QMusicScrape::adaptiveRateControl() const
+{
+    return m_adaptiveRateControl;
+}
+
+void QMusicScrape::setMaxRetries(int retries)
+{
+    m_maxRetries = qMax(0, retries);
+}
+
+int QMusicScrape::maxRetries() const
+{
+    return m_maxRetries;
+}
+
+void QMusicScrape::setStreaming(bool enabled)
+{
+    m_streaming = enabled;
+}
+
+bool QMusicScrape::streaming() const
+{
+    return m_streaming;
+}
+
+void QMusicScrape::setMaxResults(int maxResults)
+{
+    m_maxResults = qMax(0, maxResults);
+}
+
+int QMusicScrape::maxResults() const
+{
+    return m_maxResults;
+}
+
+void QMusicScrape::setDiscographyConcurrency(int releases)
+{
+    m_discographyConcurrency = qMax(1, releases);
+}
+
+int QMusicScrape::discographyConcurrency() const
+{
+    return m_discographyConcurrency;
+}
+
+void QMusicScrape::setPrefetchPolicy(const QMusicScrape::PrefetchPolicy &policy)
+{
+    m_prefetchPolicy = policy;
+    if (m_prefetchPolicy.topResults <= 0)
+        dropPrefetches();
+    else
+        startPrefetches();
+}
+
+QMusicScrape::PrefetchPolicy QMusicScrape::prefetchPolicy() const
+{
+    return m_prefetchPolicy;
+}
+
+QMusicScrape::PrefetchStats QMusicScrape::prefetchStats() const
+{
+    return m_prefetchStats;
+}
+
+void QMusicScrape::resetPrefetchStats()
+{
+    m_prefetchStats = PrefetchStats{0, 0, 0, 0, 0};
+    startPrefetches();
+}
+
+int QMusicScrape::connectionLimit(const QString &host) const
+{
+    return connectionLimit(host, m_hosts.value(host));
+}
+
+int QMusicScrape::connectionLimit(const QString &hostName, const Host &host) const
+{
+    const int maxConnections = maxConnectionsPerHost(hostName);
+    if (!m_adaptiveRateControl)
+        return maxConnections;
+    return qBound(1, (int) host.m_window, maxConnections);
+}
+
+void QMusicScrape::updateRate(const QString &hostName, Host &host, bool throttled, qint64 timeToFirstByte)
+{
+    const qint64 now = m_clock.elapsed();
+    const bool latencySpike = host.m_latencySamples >= 5 && timeToFirstByte > 3 * host.m_latencyEwma;
+
+    if (throttled || latencySpike) {
+        // multiplicative decrease, at most once per round trip, as the responses
+        // of all downloads that were in flight arrive at about the same time
+        if (host.m_lastBackoff < 0 || now - host.m_lastBackoff > host.m_latencyEwma) {
+            host.m_window = qMax(1.0, host.m_window / 2);
+            host.m_lastBackoff = now;
+            m_schedulerStats.backoffs++;
+        }
+    }
+    else {
+        // additive increase, by about one connection per window of healthy responses
+        host.m_window = qMin(host.m_window + 1.0 / host.m_window, (double) maxConnectionsPerHost(hostName));
+    }
+
+    if (!throttled) {
+        host.m_latencySamples++;
+        host.m_latencyEwma = (host.m_latencySamples == 1) ? timeToFirstByte
+                                                          : 0.8 * host.m_latencyEwma + 0.2 * timeToFirstByte;
+    }
+}
+
+qint64 QMusicScrape::retryDelay(QNetworkReply *reply, int retries) const
+{
+    // Retry-After is either a number of seconds, or an HTTP date
+    const QByteArray retryAfter = reply->rawHeader("Retry-After").trimmed();
+    if (!retryAfter.isEmpty()) {
+        bool ok = false;
+        const int seconds = retryAfter.toInt(&ok);
+        if (ok)
+            return qMax(0, seconds) * 1000ll;
+
+        QDateTime date = QLocale::c().toDateTime(QString::fromLatin1(retryAfter), "ddd, dd MMM yyyy hh:mm:ss 'GMT'");
+        date.setTimeSpec(Qt::UTC);
+        if (date.isValid())
+            return qMax(0ll, QDateTime::currentDateTimeUtc().msecsTo(date));
+    }
+
+    return qMin(1000ll << retries, 60 * 1000ll);
+}
+
+QMusicScrape::SchedulerStats QMusicScrape::schedulerStats() const
+{
+    SchedulerStats ret = m_schedulerStats;
+    for (const Host &host : m_hosts) {
+        for (int priority = 0; priority < PriorityCount; ++priority)
+            ret.queued[priority] += host.m_queues[priority].size();
+        ret.running += host.m_running;
+    }
+    return ret;
+}
+
+void QMusicScrape::resetSchedulerStats()
+{
+    m_schedulerStats = SchedulerStats{{0, 0}, 0, {0, 0}, {0, 0}, {0, 0}, 0, 0};
+}
+
+QMusicScrape::RequestId QMusicScrape::startRequest(QMusicScrape::RequestType requestType, const std::string &url,
+                                                   QMusicScrape::Priority priority,
+                                                   const ScrapeYoutube::Continuation &continuation)
+{
+    QNetworkRequest networkRequest(QUrl(QString::fromStdString(url)));
+    const QString normalizedUrl = QMusicScrapeCache::normalizedUrl(networkRequest.url());
+    const RequestId id = m_nextRequestId++;
+    m_unfinished.insert(id);
+
+    // all next pages go to the same URL, and differ only in the continuation token
+    QByteArray postData;
+    if (continuation.isValid()) {
+        postData = QByteArray::fromStdString(ScrapeYoutube::continuationBody(continuation));
+        networkRequest.setHeader(QNetworkRequest::ContentTypeHeader, QByteArray("application/json"));
+    }
+
+    // share the download of an identical request that is still queued or running
+    QString key = QString::number(requestType) + ' ' + normalizedUrl;
+    if (!postData.isEmpty())
+        key += ' ' + QString::fromStdString(continuation.token);
+    const auto existing = m_pendingRequests.find(key);
+    if (existing != m_pendingRequests.end()) {
+        PendingRequest &request = existing.value();
+        request.m_ids << id;
+        m_requestKeys.insert(id, key);
+
+        // an interactive request doesn't wait behind queued background work
+        if (priority == Interactive && request.m_priority == Background && !request.m_reply) {
+            Host &host = m_hosts[request.m_host];
+            host.m_queues[Background].removeOne(key);
+            host.m_queues[Interactive].enqueue(key);
+            request.m_priority = Interactive;
+            schedule(request.m_host);
+        }
+        return id;
+    }
+
+    PendingRequest request;
+    request.m_ids << id;
     request.m_type = requestType;
-    request.m_reply = m_network->get(QNetworkRequest(QUrl(QString::fromStdString(url))));
-    m_runningHttpRequests << request;
-    return request.m_id;
+    request.m_priority = priority;
+    request.m_request = networkRequest;
+    request.m_postData = postData;
+    request.m_continuation = continuation;
+    request.m_host = networkRequest.url().host();
+    request.m_queuedAt = m_clock.elapsed();
+    request.m_dispatchedAt = 0;
+    request.m_firstByteAt = -1;
+    request.m_retries = 0;
+    request.m_revalidating = false;
+    request.m_partialResults = 0;
+    request.m_streamComplete = false;
+
+    if (m_cache && postData.isEmpty()) {
+        request.m_cacheKey = normalizedUrl;
+
+        const QMusicScrapeCache::Lookup lookup = m_cache->lookup(request.m_cacheKey, request.m_cached);
+        if (lookup == QMusicScrapeCache::Fresh) {
+            // complete asynchronously, so that the caller sees the RequestId first
+            Completion completion;
+            completion.m_ids << id;
+            completion.m_type = requestType;
+            completion.m_error = QNetworkReply::NoError;
+            completion.m_bandcampResults = request.m_cached.bandcampResults;
+            completion.m_youtubeResults = request.m_cached.youtubeResults;
+            completion.m_continuation = request.m_cached.youtubeContinuation;
+            completion.m_hasMorePages = request.m_cached.bandcampHasMorePages;
+            completion.m_isSingleRelease = request.m_cached.bandcampSingleRelease;
+            queueCompletion(completion);
+            return id;
+        }
+        else if (lookup == QMusicScrapeCache::Stale) {
+            request.m_revalidating = true;
+            if (!request.m_cached.etag.isEmpty())
+                request.m_request.setRawHeader("If-None-Match", request.m_cached.etag);
+            if (!request.m_cached.lastModified.isEmpty())
+                request.m_request.setRawHeader("If-Modified-Since", request.m_cached.lastModified);
+        }
+    }
+
+    m_pendingRequests.insert(key, request);
+    m_requestKeys.insert(id, key);
+    m_hosts[request.m_host].m_queues[priority].enqueue(key);
+    schedule(request.m_host);
+
+    return id;
 }
 
-void QMusicScrape::onNetworkReplyFinished(QNetworkReply *reply)
+void QMusicScrape::schedule(const QString &hostName)
 {
-    int idx = -1;
-    for (int i = 0; i < m_runningHttpRequests.size(); ++i) {
-        if (m_runningHttpRequests[i].m_reply == reply) {
-            idx = i;
-            break;
+    Host &host = m_hosts[hostName];
+
+    // the host asked us to back off, wake up once the delay has passed
+    const qint64 blockedFor = host.m_blockedUntil - m_clock.elapsed();
+    if (m_adaptiveRateControl && blockedFor > 0) {
+        if (!host.m_wakeupScheduled) {
+            host.m_wakeupScheduled = true;
+            QTimer::singleShot(blockedFor, this, [this, hostName]() {
+                m_hosts[hostName].m_wakeupScheduled = false;
+                schedule(hostName);
+            });
         }
+        return;
     }
 
-    if (idx >= 0) {
-        RunningRequest request = m_runningHttpRequests.takeAt(idx);
-        const QNetworkReply::NetworkError error = reply->error();
+    const int maxConnections = connectionLimit(hostName, host);
 
-        if (error != QNetworkReply::NoError) {
-            emit networkError(request.m_id, error);
+    while (host.m_running < maxConnections) {
+        if (!host.m_queues[Interactive].isEmpty()) {
+            dispatch(host.m_queues[Interactive].dequeue(), host);
+        }
+        else if (!host.m_queues[Background].isEmpty()
+                 && (maxConnections == 1 || host.m_runningBackground < maxConnections - 1)) {
+            dispatch(host.m_queues[Background].dequeue(), host);
         }
         else {
-            const QByteArray data = reply->readAll();
-            const std::string html = data.toStdString();
+            break;
+        }
+    }
+}
 
-            switch (request.m_type) {
-            case BandcampSearch:
-                emit bandcampRequestCompleted(request.m_id, ScrapeBandcamp::searchResult(html));
-                break;
-            case BandcampAlbumInfo:
-                emit bandcampRequestCompleted(request.m_id, ScrapeBandcamp::albumInfo(html));
-                break;
-            case BandcampArtistInfo:
-                emit bandcampRequestCompleted(request.m_id,
-                        ScrapeBandcamp::bandInfoResult(reply->url().toString().toStdString(), html));
-                break;
-            case YoutubeSearch:
-                emit youtubeRequestCompleted(request.m_id, ScrapeYoutube::searchResult(html));
+void QMusicScrape::dispatch(const QString &key, Host &host)
+{
+    PendingRequest &request = m_pendingRequests[key];
+
+    const qint64 waitMs = m_clock.elapsed() - request.m_queuedAt;
+    m_schedulerStats.dispatched[request.m_priority]++;
+    m_schedulerStats.totalWaitMs[request.m_priority] += waitMs;
+    m_schedulerStats.maxWaitMs[request.m_priority] = qMax(m_schedulerStats.maxWaitMs[request.m_priority], waitMs);
+
+    host.m_running++;
+    if (request.m_priority == Background)
+        host.m_runningBackground++;
+
+    QNetworkReply *reply = request.m_postData.isEmpty() ? m_network->get(request.m_request)
+                                                        : m_network->post(request.m_request, request.m_postData);
+    request.m_reply = reply;
+    request.m_dispatchedAt = m_clock.elapsed();
+    request.m_firstByteAt = -1;
+    m_replyKeys.insert(reply, key);
+
+    // rate control measures the time to the response headers, which doesn't grow with the size of the page
+    connect(reply, &QNetworkReply::metaDataChanged, this, [this, reply]() {
+        const auto it = m_pendingRequests.find(m_replyKeys.value(reply));
+        if (it != m_pendingRequests.end() && it->m_reply == reply && it->m_firstByteAt < 0)
+            it->m_firstByteAt = m_clock.elapsed();
+    });
+
+    // streams start from scratch for every attempt, partial results that were already
+    // reported are not reported again
+    request.m_body.clear();
+    request.m_bandcampStream.reset();
+    request.m_youtubeStream.reset();
+    if (m_streaming && (request.m_type == BandcampSearch || request.m_type == YoutubeSearch)) {
+        if (request.m_type == BandcampSearch)
+            request.m_bandcampStream.reset(new ScrapeBandcamp::SearchResultStream(&m_parser));
+        else
+            request.m_youtubeStream.reset(new ScrapeYoutube::SearchResultStream(&m_parser));
+        connect(reply, &QNetworkReply::readyRead, this, [this, reply]() { onReplyReadyRead(reply); });
+    }
+}
+
+void QMusicScrape::onReplyReadyRead(QNetworkReply *reply)
+{
+    const QString key = m_replyKeys.value(reply);
+    if (key.isEmpty())
+        return;
+
+    // error pages are left for onNetworkReplyFinished()
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    PendingRequest &request = m_pendingRequests[key];
+    if (status != 200 || request.m_streamComplete)
+        return;
+
+    const QByteArray data = reply->readAll();
+    request.m_body += data;
+    if (request.m_bandcampStream)
+        request.m_bandcampStream->feed(data.constData(), data.size());
+    if (request.m_youtubeStream)
+        request.m_youtubeStream->feed(data.constData(), data.size());
+
+    emitPartialResults(request);
+
+    // connected slots may have cancelled this request, or started others
+    const auto it = m_pendingRequests.find(key);
+    if (it == m_pendingRequests.end() || it->m_reply != reply)
+        return;
+
+    if (m_maxResults > 0 && it->m_partialResults >= m_maxResults) {
+        // abort() emits finished() right away, which removes the request
+        it->m_streamComplete = true;
+        reply->abort();
+    }
+}
+
+void QMusicScrape::emitPartialResults(PendingRequest &request)
+{
+    const int remaining = (m_maxResults > 0) ? m_maxResults - request.m_partialResults : INT_MAX;
+    if (remaining <= 0)
+        return;
+
+    // the signals come last, as connected slots may start or cancel requests, which
+    // invalidates the reference
+    const QVector<RequestId> ids = request.m_ids;
+
+    if (request.m_bandcampStream) {
+        ScrapeBandcamp::ResultList results = request.m_bandcampStream->takeNewResults();
+        if (results.size() > (size_t) remaining)
+            results.resize(remaining);
+        if (results.empty())
+            return;
+        request.m_partialResults += results.size();
+        for (RequestId id : ids) {
+            // pages of a multi-page search are reported in rank order, once complete
+            if (m_unfinished.count(id) && !m_searchPageOwners.contains(id))
+                emit bandcampResultsPartial(id, results);
+        }
+    }
+    else if (request.m_youtubeStream) {
+        ScrapeYoutube::ResultList results = request.m_youtubeStream->takeNewResults();
+        if (results.size() > (size_t) remaining)
+            results.resize(remaining);
+        if (results.empty())
+            return;
+        request.m_partialResults += results.size();
+        for (RequestId id : ids) {
+            if (m_unfinished.count(id))
+                emit youtubeResultsPartial(id, results);
+        }
+    }
+}
+
+bool QMusicScrape::finishStream(PendingRequest &request, const QByteArray &rest, Completion &completion)
+{
+    if (request.m_bandcampStream) {
+        if (!request.m_streamComplete) {
+            request.m_bandcampStream->feed(rest.constData(), rest.size());
+            request.m_bandcampStream->finish();
+        }
+        emitPartialResults(request);
+        completion.m_bandcampResults = request.m_bandcampStream->results();
+        if (!request.m_streamComplete)
+            completion.m_hasMorePages = request.m_bandcampStream->hasMorePages();
+        if (m_maxResults > 0 && completion.m_bandcampResults.size() > (size_t) m_maxResults)
+            completion.m_bandcampResults.resize(m_maxResults);
+        return !completion.m_bandcampResults.empty();
+    }
+
+    if (request.m_youtubeStream) {
+        if (!request.m_streamComplete) {
+            request.m_youtubeStream->feed(rest.constData(), rest.size());
+            request.m_youtubeStream->finish();
+        }
+        emitPartialResults(request);
+        completion.m_youtubeResults = request.m_youtubeStream->results();
+        if (!request.m_streamComplete)
+            completion.m_continuation = request.m_youtubeStream->continuation();
+        if (m_maxResults > 0 && completion.m_youtubeResults.size() > (size_t) m_maxResults)
+            completion.m_youtubeResults.resize(m_maxResults);
+        return !completion.m_youtubeResults.empty();
+    }
+
+    return false;
+}
+
+bool QMusicScrape::cancel(QMusicScrape::RequestId id)
+{
+    if (m_unfinished.erase(id) == 0)
+        return false;
+    m_heldBack.remove(id);
+    dropRequest(id);
+
+    // results that were held back for this request can go out now
+    releaseHeldBack();
+    return true;
+}
+
+void QMusicScrape::dropRequest(QMusicScrape::RequestId id)
+{
+    // a multi-page search has no download of its own, but one for each page
+    const auto search = m_multiPageSearches.find(id);
+    if (search != m_multiPageSearches.end()) {
+        const QVector<SearchPage> pages = search->m_pages;
+        m_multiPageSearches.erase(search);
+        for (const SearchPage &page : pages) {
+            if (m_searchPageOwners.remove(page.m_id))
+                cancel(page.m_id);
+        }
+        return;
+    }
+
+    // the same for a discography, with the band page and the release pages that are running
+    const auto discography = m_discographies.find(id);
+    if (discography != m_discographies.end()) {
+        QVector<RequestId> requests = discography->m_releaseRequests;
+        requests << discography->m_artistRequest;
+        m_discographies.erase(discography);
+        for (RequestId request : requests) {
+            if (m_discographyOwners.remove(request))
+                cancel(request);
+        }
+        return;
+    }
+
+    // a parse that is already running will still finish, but emitCompletion() skips the id
+    const auto keyIt = m_requestKeys.find(id);
+    if (keyIt == m_requestKeys.end())
+        return;
+    const QString key = keyIt.value();
+    m_requestKeys.erase(keyIt);
+
+    PendingRequest &request = m_pendingRequests[key];
+    request.m_ids.removeOne(id);
+    if (!request.m_ids.isEmpty())
+        return;
+
+    Host &host = m_hosts[request.m_host];
+    const QString hostName = request.m_host;
+
+    if (request.m_reply) {
+        QNetworkReply *reply = request.m_reply;
+        host.m_running--;
+        if (request.m_priority == Background)
+            host.m_runningBackground--;
+        m_replyKeys.remove(reply);
+        m_pendingRequests.remove(key);
+
+        // abort() emits finished(), which doesn't find the reply anymore, and deletes it
+        reply->abort();
+    }
+    else {
+        host.m_queues[request.m_priority].removeOne(key);
+        m_pendingRequests.remove(key);
+    }
+
+    schedule(hostName);
+}
+
+void QMusicScrape::parse(Completion &completion, const QByteArray &data, const std::string &url, ScrapeParser *parser)
+{
+    const char *html = data.constData();
+    const size_t length = data.size();
+
+    switch (completion.m_type) {
+    case BandcampSearch:
+        completion.m_bandcampResults = ScrapeBandcamp::searchResult(html, length, parser, &completion.m_hasMorePages);
+        break;
+    case BandcampAlbumInfo:
+        completion.m_bandcampResults = ScrapeBandcamp::albumInfo(html, length, parser);
+        break;
+    case BandcampArtistInfo: {
+        // the page comes from bandInfoUrl(), but the links to the releases are relative to the band itself
+        std::string bandUrl = url;
+        const std::string musicPath = "/music";
+        if (bandUrl.size() >= musicPath.size() && !bandUrl.compare(bandUrl.size() - musicPath.size(), musicPath.size(), musicPath))
+            bandUrl.resize(bandUrl.size() - musicPath.size());
+        while (!bandUrl.empty() && bandUrl.back() == '/')
+            bandUrl.pop_back();
+        completion.m_bandcampResults = ScrapeBandcamp::bandInfoResult(bandUrl, html, length,
+                                                                      &completion.m_isSingleRelease, parser);
+        break;
+    }
+    case YoutubeSearch:
+        completion.m_youtubeResults = ScrapeYoutube::searchResult(html, length, parser, &completion.m_continuation);
+        break;
+    case YoutubeNextPage:
+        completion.m_youtubeResults = ScrapeYoutube::continuationResult(html, length, parser, &completion.m_continuation);
+        break;
+    default:
+        qFatal("QMusicScrape: Invalid request type");
+    }
+}
+
+void QMusicScrape::onNetworkReplyFinished(QNetworkReply *reply)
+{
+    const QString key = m_replyKeys.take(reply);
+
+    if (!key.isEmpty()) {
+        PendingRequest &pending = m_pendingRequests[key];
+        Host &host = m_hosts[pending.m_host];
+        host.m_running--;
+        if (pending.m_priority == Background)
+            host.m_runningBackground--;
+
+        const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+        if (m_adaptiveRateControl) {
+            const bool throttled = (status == 429 || status == 503);
+            const qint64 firstByteAt = (pending.m_firstByteAt >= 0) ? pending.m_firstByteAt : m_clock.elapsed();
+            updateRate(pending.m_host, host, throttled, firstByteAt - pending.m_dispatchedAt);
+
+            // put throttled requests back at the front of their queue
+            if (throttled && pending.m_retries < m_maxRetries) {
+                const qint64 delay = retryDelay(reply, pending.m_retries);
+                host.m_blockedUntil = qMax(host.m_blockedUntil, m_clock.elapsed() + delay);
+                pending.m_retries++;
+                pending.m_reply = nullptr;
+                pending.m_queuedAt = m_clock.elapsed();
+                host.m_queues[pending.m_priority].prepend(key);
+                m_schedulerStats.retries++;
+
+                schedule(pending.m_host);
+                reply->deleteLater();
+                return;
+            }
+        }
+
+        PendingRequest request = m_pendingRequests.take(key);
+        for (RequestId id : request.m_ids)
+            m_requestKeys.remove(id);
+
+        Completion completion;
+        completion.m_ids = request.m_ids;
+        completion.m_type = request.m_type;
+        completion.m_error = request.m_streamComplete ? QNetworkReply::NoError : reply->error();
+        completion.m_continuation = request.m_continuation;
+        completion.m_hasMorePages = true;
+        completion.m_isSingleRelease = false;
+
+        // in streaming mode, the first part of the page has already been read
+        const QByteArray rest = request.m_streamComplete ? QByteArray() : reply->readAll();
+        const QByteArray body = request.m_body.isEmpty() ? rest : request.m_body + rest;
+
+        for (RequestId id : request.m_ids) {
+            if (m_prefetchRequests.contains(id)) {
+                m_prefetchStats.bytes += body.size();
                 break;
-            default:
-                qFatal("QMusicScrape: Invalid request type");
             }
         }
+
+        if (completion.m_error != QNetworkReply::NoError) {
+            complete(completion);
+        }
+        else if (request.m_revalidating && status == 304) {
+            // not modified: re-use the cached results, without transfer or parse
+            QMusicScrapeCache::Entry entry = request.m_cached;
+            if (reply->hasRawHeader("ETag"))
+                entry.etag = reply->rawHeader("ETag");
+            entry.expires = QDateTime::currentMSecsSinceEpoch() + 1000ll * m_cacheTtl[request.m_type];
+            if (m_cache)
+                m_cache->revalidated(request.m_cacheKey, entry);
+
+            completion.m_bandcampResults = entry.bandcampResults;
+            completion.m_youtubeResults = entry.youtubeResults;
+            completion.m_continuation = entry.youtubeContinuation;
+            completion.m_hasMorePages = entry.bandcampHasMorePages;
+            completion.m_isSingleRelease = entry.bandcampSingleRelease;
+            complete(completion);
+        }
+        else if (finishStream(request, rest, completion)) {
+            // results that were cut off at maxResults are not cached
+            if (!request.m_streamComplete) {
+                completion.m_cacheKey = request.m_cacheKey;
+                completion.m_etag = reply->rawHeader("ETag");
+                completion.m_lastModified = reply->rawHeader("Last-Modified");
+            }
+            complete(completion);
+        }
+        else if (m_threadPool) {
+            completion.m_cacheKey = request.m_cacheKey;
+            completion.m_etag = reply->rawHeader("ETag");
+            completion.m_lastModified = reply->rawHeader("Last-Modified");
+            {
+                QMutexLocker lock(&m_parseMutex);
+                m_parsesInFlight++;
+            }
+            m_threadPool->start(new ParseTask(this, completion, body, reply->url().toString().toStdString()));
+        }
+        else {
+            completion.m_cacheKey = request.m_cacheKey;
+            completion.m_etag = reply->rawHeader("ETag");
+            completion.m_lastModified = reply->rawHeader("Last-Modified");
+            parse(completion, body, reply->url().toString().toStdString(), &m_parser);
+            complete(completion);
+        }
+
+        schedule(request.m_host);
     }
 
     reply->deleteLater();
 }
 
-QMusicScrape::RequestId QMusicScrape::bandcampSearch(const QString &pattern)
+void QMusicScrape::queueCompletion(const Completion &completion)
 {
-    return startRequest(BandcampSearch, ScrapeBandcamp::searchUrl(pattern.toStdString()));
+    QMutexLocker lock(&m_parseMutex);
+    const bool wasEmpty = m_finishedParses.isEmpty();
+    m_finishedParses << completion;
+    if (wasEmpty)
+        QMetaObject::invokeMethod(this, "processFinishedParses", Qt::QueuedConnection);
 }
 
-QMusicScrape::RequestId QMusicScrape::bandcampArtistInfo(const QString &artistUrl)
+void QMusicScrape::finishParse(const Completion &completion)
 {
-    return startRequest(BandcampArtistInfo, ScrapeBandcamp::bandInfoUrl(artistUrl.toStdString()));
+    // called on a pool thread. The destructor waits for m_parsesInFlight to drop to 0,
+    // so the queued call must be posted before that.
+    queueCompletion(completion);
+
+    QMutexLocker lock(&m_parseMutex);
+    m_parsesInFlight--;
+    m_parseDone.wakeAll();
 }
 
-QMusicScrape::RequestId QMusicScrape::bandcampAlbumInfo(const QString &albumUrl)
+void QMusicScrape::processFinishedParses()
 {
-    return startRequest(BandcampAlbumInfo, albumUrl.toStdString());
+    QVector<Completion> finished;
+    {
+        QMutexLocker lock(&m_parseMutex);
+        finished.swap(m_finishedParses);
+    }
+
+    for (const Completion &completion : finished)
+        complete(completion);
 }
 
-QMusicScrape::RequestId QMusicScrape::youtubeSearch(const QString &pattern)
+void QMusicScrape::complete(const Completion &completion)
 {
-    return startRequest(YoutubeSearch, ScrapeYoutube::searchUrl(pattern.toStdString()));
+    // pages that didn't yield anything are not cached, they may well be a layout hiccup
+    const bool hasResults = !completion.m_bandcampResults.empty() || !completion.m_youtubeResults.empty();
+    if (m_cache && !completion.m_cacheKey.isEmpty() && completion.m_error == QNetworkReply::NoError && hasResults) {
+        QMusicScrapeCache::Entry entry;
+        entry.bandcampResults = completion.m_bandcampResults;
+        entry.youtubeResults = completion.m_youtubeResults;
+        entry.youtubeContinuation = completion.m_continuation;
+        entry.bandcampSingleRelease = completion.m_isSingleRelease;
+        entry.bandcampHasMorePages = completion.m_hasMorePages;
+        entry.etag = completion.m_etag;
+        entry.lastModified = completion.m_lastModified;
+        entry.expires = QDateTime::currentMSecsSinceEpoch() + 1000ll * m_cacheTtl[completion.m_type];
+        m_cache->insert(completion.m_cacheKey, entry);
+    }
+
+    // pages of multi-page searches and discographies are merged first, and reported with those
+    QVector<RequestId> ids;
+    for (RequestId id : completion.m_ids) {
+        if (m_searchPageOwners.contains(id))
+            searchPageCompleted(id, completion);
+        else if (m_discographyOwners.contains(id))
+            discographyRequestCompleted(id, completion);
+        else if (m_prefetchRequests.contains(id))
+            prefetchCompleted(id, completion);
+        else
+            ids << id;
+    }
+
+    // a search is likely to be followed by a request for one of its first albums or bands
+    if (completion.m_type == BandcampSearch && completion.m_error == QNetworkReply::NoError && !ids.isEmpty())
+        prefetch(completion.m_bandcampResults);
+
+    if (m_resultOrder == CompletionOrder) {
+        for (RequestId id : ids)
+            emitCompletion(id, completion);
+        return;
+    }
+
+    // hold results back until all earlier requests are done
+    const QSharedPointer<const Completion> shared(new Completion(completion));
+    for (RequestId id : ids) {
+        if (m_unfinished.count(id))
+            m_heldBack.insert(id, shared);
+    }
+    releaseHeldBack();
+}
+
+void QMusicScrape::releaseHeldBack()
+{
+    // emits the held back results up to the first request that is still unfinished
+    while (!m_unfinished.empty() && m_heldBack.contains(*m_unfinished.begin())) {
+        const RequestId id = *m_unfinished.begin();
+        emitCompletion(id, *m_heldBack.take(id));
+    }
+}
+
+void QMusicScrape::searchPageCompleted(RequestId pageId, const Completion &completion)
+{
+    const RequestId id = m_searchPageOwners.take(pageId);
+    if (m_unfinished.erase(pageId) == 0)
+        return;
+
+    const auto searchIt = m_multiPageSearches.find(id);
+    if (searchIt == m_multiPageSearches.end()) {
+        releaseHeldBack();
+        return;
+    }
+    MultiPageSearch &search = searchIt.value();
+
+    for (SearchPage &page : search.m_pages) {
+        if (page.m_id == pageId) {
+            page.m_complete = true;
+            page.m_error = completion.m_error;
+            page.m_results = completion.m_bandcampResults;
+            page.m_last = completion.m_error != QNetworkReply::NoError || page.m_results.empty()
+                    || !completion.m_hasMorePages;
+        }
+    }
+
+    // merge the leading complete pages, up to the last one that exists
+    ScrapeBandcamp::ResultList newResults;
+    bool done = false;
+    while (!done && search.m_reported < search.m_pages.size() && search.m_pages[search.m_reported].m_complete) {
+        const SearchPage &page = search.m_pages[search.m_reported++];
+        newResults.insert(newResults.end(), page.m_results.begin(), page.m_results.end());
+        done = page.m_last;
+    }
+    done = done || search.m_reported == search.m_pages.size();
+
+    // the signals come last, as connected slots may start or cancel requests
+    if (!done) {
+        if (m_streaming && !newResults.empty())
+            emit bandcampResultsPartial(id, newResults);
+        releaseHeldBack();
+        return;
+    }
+
+    Completion merged;
+    merged.m_ids << id;
+    merged.m_type = BandcampSearch;
+    merged.m_error = search.m_pages.first().m_error;
+    merged.m_hasMorePages = !search.m_pages[search.m_reported - 1].m_last;
+    merged.m_isSingleRelease = false;
+    for (int i = 0; i < search.m_reported; ++i) {
+        const ScrapeBandcamp::ResultList &results = search.m_pages[i].m_results;
+        merged.m_bandcampResults.insert(merged.m_bandcampResults.end(), results.begin(), results.end());
+    }
+
+    // pages after the last one are not needed anymore
+    const QVector<SearchPage> pages = search.m_pages;
+    m_multiPageSearches.erase(searchIt);
+    for (const SearchPage &page : pages) {
+        if (m_searchPageOwners.remove(page.m_id))
+            cancel(page.m_id);
+    }
+
+    if (m_streaming && !newResults.empty() && merged.m_error == QNetworkReply::NoError)
+        emit bandcampResultsPartial(id, newResults);
+    complete(merged);
+}
+
+void QMusicScrape::discographyRequestCompleted(RequestId requestId, const Completion &completion)
+{
+    const RequestId id = m_discographyOwners.take(requestId);
+    if (m_unfinished.erase(requestId) == 0)
+        return;
+
+    const auto discographyIt = m_discographies.find(id);
+    if (discographyIt == m_discographies.end()) {
+        releaseHeldBack();
+        return;
+    }
+    Discography &discography = discographyIt.value();
+
+    if (requestId != discography.m_artistRequest) {
+        // a failed release is left out, the others are still worth having
+        const int index = discography.m_releaseRequests.indexOf(requestId);
+        if (completion.m_error == QNetworkReply::NoError)
+            discography.m_tracks[index] = completion.m_bandcampResults;
+        discography.m_running--;
+        continueDiscography(id, discography.m_tracks[index]);
+        return;
+    }
+
+    discography.m_artistRequest = 0;
+    if (completion.m_error != QNetworkReply::NoError) {
+        Completion failed;
+        failed.m_ids << id;
+        failed.m_type = BandcampArtistInfo;
+        failed.m_error = completion.m_error;
+        failed.m_hasMorePages = false;
+        failed.m_isSingleRelease = false;
+        m_discographies.erase(discographyIt);
+        complete(failed);
+        return;
+    }
+
+    // with a single release, the band page shows its tracks right away
+    if (completion.m_isSingleRelease) {
+        discography.m_tracks << completion.m_bandcampResults;
+        continueDiscography(id, completion.m_bandcampResults);
+        return;
+    }
+
+    for (const ScrapeBandcamp::Result &release : completion.m_bandcampResults) {
+        if (!release.url.empty())
+            discography.m_releaseUrls.push_back(release.url);
+    }
+    discography.m_releaseRequests.fill(0, discography.m_releaseUrls.size());
+    discography.m_tracks.resize(discography.m_releaseUrls.size());
+    continueDiscography(id, ScrapeBandcamp::ResultList());
+}
+
+void QMusicScrape::continueDiscography(RequestId id, const ScrapeBandcamp::ResultList &newTracks)
+{
+    // newTracks may point into the discography, which is gone once it's complete
+    const ScrapeBandcamp::ResultList tracks = newTracks;
+    Discography &discography = m_discographies[id];
+
+    // a few releases at a time, so that a large discography doesn't crowd out other requests.
+    // Cached releases are only reported asynchronously, so the requests can be registered after starting them.
+    while (discography.m_running < m_discographyConcurrency
+           && discography.m_started < (int) discography.m_releaseUrls.size()) {
+        const RequestId request = startRequest(BandcampAlbumInfo, discography.m_releaseUrls[discography.m_started],
+                                               discography.m_priority);
+        discography.m_releaseRequests[discography.m_started++] = request;
+        discography.m_running++;
+        m_discographyOwners.insert(request, id);
+    }
+
+    const bool done = discography.m_running == 0 && discography.m_started == (int) discography.m_releaseUrls.size();
+    Completion completion;
+    if (done) {
+        completion.m_ids << id;
+        completion.m_type = BandcampArtistInfo;
+        completion.m_error = QNetworkReply::NoError;
+        completion.m_hasMorePages = false;
+        completion.m_isSingleRelease = discography.m_releaseUrls.empty();
+        for (const ScrapeBandcamp::ResultList &releaseTracks : discography.m_tracks) {
+            completion.m_bandcampResults.insert(completion.m_bandcampResults.end(),
+                                                releaseTracks.begin(), releaseTracks.end());
+        }
+        m_discographies.remove(id);
+    }
+
+    // the signals come last, as connected slots may start or cancel requests
+    if (!tracks.empty() && m_unfinished.count(id))
+        emit bandcampResultsPartial(id, tracks);
+    if (done)
+        complete(completion);
+    else
+        releaseHeldBack();
+}
+
+void QMusicScrape::prefetch(const ScrapeBandcamp::ResultList &results)
+{
+    if (!m_cache || m_prefetchPolicy.topResults <= 0)
+        return;
+
+    QVector<Prefetch> pages;
+    QSet<QString> keys;
+    int candidates = 0;
+    for (const ScrapeBandcamp::Result &result : results) {
+        if (candidates >= m_prefetchPolicy.topResults)
+            break;
+        if (result.url.empty())
+            continue;
+
+        Prefetch page;
+        if (result.resultType == ScrapeBandcamp::Result::Album) {
+            page.m_type = BandcampAlbumInfo;
+            page.m_url = result.url;
+        }
+        else if (result.resultType == ScrapeBandcamp::Result::Band) {
+            page.m_type = BandcampArtistInfo;
+            page.m_url = ScrapeBandcamp::bandInfoUrl(result.url);
+        }
+        else {
+            continue;
+        }
+        candidates++;
+
+        page.m_cacheKey = QMusicScrapeCache::normalizedUrl(QUrl(QString::fromStdString(page.m_url)));
+        pages << page;
+        keys.insert(page.m_cacheKey);
+    }
+
+    // the previous search's predictions are out of date, except for the pages this one predicts as
+    // well, and prefetched pages that have left the cache without being requested won't be anymore
+    dropPrefetches(keys);
+    for (auto it = m_prefetchedKeys.begin(); it != m_prefetchedKeys.end(); ) {
+        if (!m_cache->isFresh(*it) && !m_runningPrefetchKeys.contains(*it))
+            it = m_prefetchedKeys.erase(it);
+        else
+            ++it;
+    }
+
+    for (const Prefetch &page : pages) {
+        if (m_prefetchedKeys.contains(page.m_cacheKey) || m_runningPrefetchKeys.contains(page.m_cacheKey)
+                || m_cache->isFresh(page.m_cacheKey))
+            continue;
+        m_prefetchedKeys.insert(page.m_cacheKey);
+        m_prefetchQueue.enqueue(page);
+    }
+
+    startPrefetches();
+}
+
+void QMusicScrape::startPrefetches()
+{
+    while (!m_prefetchQueue.isEmpty() && m_prefetchRequests.size() < m_prefetchPolicy.maxConcurrent) {
+        if (m_prefetchPolicy.maxBytes > 0 && m_prefetchStats.bytes >= (quint64) m_prefetchPolicy.maxBytes) {
+            dropPrefetches();
+            return;
+        }
+
+        // already requested in the meantime
+        const Prefetch page = m_prefetchQueue.dequeue();
+        if (!m_prefetchedKeys.contains(page.m_cacheKey))
+            continue;
+
+        // prefetches are never reported, and don't hold back other results for RequestOrder
+        const RequestId id = startRequest(page.m_type, page.m_url, Background);
+        m_unfinished.erase(id);
+        m_prefetchRequests.insert(id, page.m_cacheKey);
+        m_runningPrefetchKeys.insert(page.m_cacheKey);
+        m_prefetchStats.started++;
+    }
+}
+
+void QMusicScrape::dropPrefetches(const QSet<QString> &keep)
+{
+    while (!m_prefetchQueue.isEmpty()) {
+        m_prefetchedKeys.remove(m_prefetchQueue.dequeue().m_cacheKey);
+        m_prefetchStats.dropped++;
+    }
+
+    // cancel() doesn't know prefetches, as they are never reported. Those that are queued or
+    // downloading are dropped here, a running parse still finishes into the cache.
+    QVector<RequestId> dropped;
+    for (auto it = m_prefetchRequests.begin(); it != m_prefetchRequests.end(); ) {
+        if (keep.contains(it.value()) || !m_requestKeys.contains(it.key())) {
+            ++it;
+            continue;
+        }
+        dropped << it.key();
+        m_runningPrefetchKeys.remove(it.value());
+        m_prefetchedKeys.remove(it.value());
+        it = m_prefetchRequests.erase(it);
+        m_prefetchStats.dropped++;
+    }
+    for (RequestId id : dropped)
+        dropRequest(id);
+}
+
+void QMusicScrape::prefetchCompleted(RequestId id, const Completion &completion)
+{
+    // complete() only caches pages with results
+    const QString cacheKey = m_prefetchRequests.take(id);
+    m_runningPrefetchKeys.remove(cacheKey);
+    if (completion.m_error == QNetworkReply::NoError && !completion.m_bandcampResults.empty())
+        m_prefetchStats.completed++;
+    else
+        m_prefetchedKeys.remove(cacheKey);
+
+    startPrefetches();
+}
+
+void QMusicScrape::countPrefetchHit(const std::string &url)
+{
+    if (m_prefetchedKeys.isEmpty())
+        return;
+
+    // each prefetched page counts at most once, with the first request for it
+    const QString cacheKey = QMusicScrapeCache::normalizedUrl(QUrl(QString::fromStdString(url)));
+    if (!m_prefetchedKeys.remove(cacheKey))
+        return;
+
+    // only a finished prefetch whose entry is served from the cache is a hit, not one that is
+    // still downloading, or was evicted since
+    const bool running = m_runningPrefetchKeys.contains(cacheKey);
+    if (!running && m_cache && m_cache->isFresh(cacheKey))
+        m_prefetchStats.hits++;
+}
+
+void QMusicScrape::emitCompletion(RequestId id, const Completion &completion)
+{
+    // cancelled requests are not reported
+    if (m_unfinished.erase(id) == 0)
+        return;
+
+    if (completion.m_error != QNetworkReply::NoError) {
+        emit networkError(id, completion.m_error);
+        return;
+    }
+
+    switch (completion.m_type) {
+    case BandcampSearch:
+    case BandcampAlbumInfo:
+    case BandcampArtistInfo:
+        emit bandcampRequestCompleted(id, completion.m_bandcampResults);
+        break;
+    case YoutubeSearch:
+    case YoutubeNextPage:
+        if (completion.m_continuation.isValid())
+            emit youtubeNextPageAvailable(id, completion.m_continuation);
+        emit youtubeRequestCompleted(id, completion.m_youtubeResults);
+        break;
+    default:
+        qFatal("QMusicScrape: Invalid request type");
+    }
+}
+
+QMusicScrape::RequestId QMusicScrape::bandcampSearch(const QString &pattern, Priority priority)
+{
+    return startRequest(BandcampSearch, ScrapeBandcamp::searchUrl(pattern.toStdString()), priority);
+}
+
+QMusicScrape::RequestId QMusicScrape::bandcampSearch(const QString &pattern, ScrapeBandcamp::SearchItemType itemType,
+                                                     int pages, Priority priority)
+{
+    const RequestId id = m_nextRequestId++;
+    m_unfinished.insert(id);
+
+    // results of cached pages are only reported asynchronously, so the pages can be
+    // registered after starting them
+    MultiPageSearch search;
+    search.m_reported = 0;
+    for (int page = 1; page <= qMax(1, pages); ++page) {
+        SearchPage searchPage;
+        searchPage.m_id = startRequest(BandcampSearch, ScrapeBandcamp::searchUrl(pattern.toStdString(), itemType, page),
+                                       priority);
+        searchPage.m_complete = false;
+        searchPage.m_last = false;
+        searchPage.m_error = QNetworkReply::NoError;
+        search.m_pages << searchPage;
+        m_searchPageOwners.insert(searchPage.m_id, id);
+    }
+    m_multiPageSearches.insert(id, search);
+
+    return id;
+}
+
+QMusicScrape::RequestId QMusicScrape::bandcampArtistInfo(const QString &artistUrl, Priority priority)
+{
+    const std::string url = ScrapeBandcamp::bandInfoUrl(artistUrl.toStdString());
+    countPrefetchHit(url);
+    return startRequest(BandcampArtistInfo, url, priority);
+}
+
+QMusicScrape::RequestId QMusicScrape::bandcampAlbumInfo(const QString &albumUrl, Priority priority)
+{
+    const std::string url = albumUrl.toStdString();
+    countPrefetchHit(url);
+    return startRequest(BandcampAlbumInfo, url, priority);
+}
+
+QMusicScrape::RequestId QMusicScrape::bandcampDiscography(const QString &artistUrl, Priority priority)
+{
+    const RequestId id = m_nextRequestId++;
+    m_unfinished.insert(id);
+
+    Discography discography;
+    discography.m_priority = priority;
+    discography.m_started = 0;
+    discography.m_running = 0;
+    discography.m_artistRequest = startRequest(BandcampArtistInfo, ScrapeBandcamp::bandInfoUrl(artistUrl.toStdString()),
+                                               priority);
+    m_discographyOwners.insert(discography.m_artistRequest, id);
+    m_discographies.insert(id, discography);
+
+    return id;
+}
+
+QMusicScrape::RequestId QMusicScrape::youtubeSearch(const QString &pattern, Priority priority)
+{
+    return startRequest(YoutubeSearch, ScrapeYoutube::searchUrl(pattern.toStdString()), priority);
+}
+
+QMusicScrape::RequestId QMusicScrape::youtubeNextPage(const ScrapeYoutube::Continuation &continuation, Priority priority)
+{
+    if (!continuation.isValid()) {
+        qWarning("QMusicScrape: Invalid YouTube continuation");
+        return 0;
+    }
+    return startRequest(YoutubeNextPage, ScrapeYoutube::continuationUrl(continuation), priority, continuation);
 }
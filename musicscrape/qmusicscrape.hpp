@@ -23,12 +23,26 @@
 
 #include <QObject>
 #include <QVector>
+#include <QList>
+#include <QMap>
+#include <QHash>
+#include <QQueue>
+#include <QSet>
+#include <QSharedPointer>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
 #include <QPointer>
+#include <QNetworkRequest>
 #include <QNetworkReply>
 
+#include <set>
+
 #include "musicscrape/musicscrape.hpp"
+#include "musicscrape/qmusicscrapecache.hpp"
 
 class QNetworkAccessManager;
+class QThreadPool;
 
 class QMusicScrape : public QObject
 {
@@ -37,48 +51,407 @@ class QMusicScrape : public QObject
 public:
     using RequestId = quint32;
 
+    enum RequestType
+    {
+        BandcampSearch,
+        BandcampArtistInfo,
+        BandcampAlbumInfo,
+        YoutubeSearch,
+        YoutubeNextPage,
+        RequestTypeCount
+    };
+
+    /**
+     * Order in which the completion signals (including networkError()) are emitted
+     */
+    enum ResultOrder
+    {
+        CompletionOrder,    // as soon as a request is parsed
+        RequestOrder        // in the order in which the requests were started
+    };
+
+    /**
+     * Interactive requests are always dispatched before queued Background requests, and
+     * Background requests leave one connection per host free for Interactive ones.
+     */
+    enum Priority
+    {
+        Interactive,
+        Background,
+        PriorityCount
+    };
+
+    struct SchedulerStats
+    {
+        int queued[PriorityCount];          // currently waiting for a connection
+        int running;                        // currently downloading
+        quint64 dispatched[PriorityCount];  // sent to the network since the last reset
+        qint64 totalWaitMs[PriorityCount];  // time spent in the queue by the dispatched requests
+        qint64 maxWaitMs[PriorityCount];
+        quint64 retries;                    // requests that were re-sent after a 429 or 503
+        quint64 backoffs;                   // multiplicative decreases of a host's concurrency
+    };
+
+    /**
+     * Speculative prefetch of the pages that are likely to be opened after a Bandcamp search
+     */
+    struct PrefetchPolicy
+    {
+        PrefetchPolicy() : topResults(0), maxConcurrent(2), maxBytes(16 * 1024 * 1024) {}
+
+        int topResults;     // albums and bands among the first results of a search, 0 disables prefetching
+        int maxConcurrent;  // prefetches downloading at once
+        qint64 maxBytes;    // downloaded by prefetches until resetPrefetchStats(), 0 for no limit
+    };
+
+    struct PrefetchStats
+    {
+        quint64 started;
+        quint64 completed;  // parsed and stored in the cache
+        quint64 dropped;    // queued or downloading, but superseded by a newer search or over the byte budget
+        quint64 bytes;      // downloaded by prefetches
+        quint64 hits;       // requests that were served a completed prefetch from the cache
+
+        // share of the completed prefetches that were requested afterwards, between 0 and 1
+        double hitRate() const { return completed ? (double) hits / completed : 0.0; }
+    };
+
     QMusicScrape(QObject *parent = nullptr);
     ~QMusicScrape();
 
-    RequestId bandcampSearch(const QString &pattern);
-    RequestId bandcampArtistInfo(const QString &artistUrl);
-    RequestId bandcampAlbumInfo(const QString &albumUrl);
+    /**
+     * Pool on which the downloaded pages are parsed, QThreadPool::globalInstance() by default.
+     * With a nullptr pool, pages are parsed synchronously on the thread that owns this object.
+     * Either way, all signals are emitted on the owning thread.
+     */
+    void setThreadPool(QThreadPool *threadPool);
+    QThreadPool *threadPool() const;
+
+    /**
+     * Network access manager for all downloads, e.g. to set up a proxy. It is not owned by
+     * QMusicScrape, and has to outlive it. Must be set before the first request is started.
+     */
+    void setNetworkAccessManager(QNetworkAccessManager *network);
+    QNetworkAccessManager *networkAccessManager() const;
+
+    void setResultOrder(ResultOrder order);
+    ResultOrder resultOrder() const;
+
+    /**
+     * Cache for parsed results, which is not owned by QMusicScrape. No caching by default.
+     *
+     * Fresh entries complete a request without any network access. Stale entries are revalidated
+     * with If-None-Match/If-Modified-Since, and a 304 response completes the request without
+     * transferring or parsing the page again.
+     */
+    void setCache(QMusicScrapeCache *cache);
+    QMusicScrapeCache *cache() const;
+
+    /**
+     * Time in seconds for which a cached result of the given type is used without revalidation
+     */
+    void setCacheTtl(RequestType type, int seconds);
+    int cacheTtl(RequestType type) const;
+
+    /**
+     * Maximum number of concurrent downloads per host, 4 by default. The per-host value
+     * overrides the default for that host.
+     */
+    void setMaxConnectionsPerHost(int connections);
+    void setMaxConnectionsPerHost(const QString &host, int connections);
+    int maxConnectionsPerHost(const QString &host = QString()) const;
+
+    /**
+     * Adaptive rate control, enabled by default. The number of concurrent downloads per host grows
+     * additively (up to maxConnectionsPerHost()) while the host responds quickly, and is halved on
+     * HTTP 429/503 or when the response headers take much longer than usual. Throttled requests
+     * are retried transparently, up to maxRetries() times, after the server's Retry-After delay or
+     * an exponential backoff.
+     * Without it, 429/503 responses are reported through networkError().
+     */
+    void setAdaptiveRateControl(bool enabled);
+    bool adaptiveRateControl() const;
+    void setMaxRetries(int retries);
+    int maxRetries() const;
+
+    /**
+     * Current concurrency limit for the given host
+     */
+    int connectionLimit(const QString &host) const;
+
+    /**
+     * Streaming mode for search requests, disabled by default. Search pages are then parsed
+     * incrementally while they download, and every batch of new results is reported through
+     * bandcampResultsPartial() or youtubeResultsPartial() right away. The completion signal
+     * still carries the full result list.
+     *
+     * With maxResults > 0, the download is aborted as soon as that many results were found.
+     */
+    void setStreaming(bool enabled);
+    bool streaming() const;
+    void setMaxResults(int maxResults);
+    int maxResults() const;
+
+    /**
+     * Maximum number of release pages that a bandcampDiscography() request fetches at once, 4 by default
+     */
+    void setDiscographyConcurrency(int releases);
+    int discographyConcurrency() const;
+
+    /**
+     * Prefetching, disabled by default. Whenever a Bandcamp search completes, the pages of the first
+     * topResults albums and bands among its results are downloaded at Background priority and
+     * parsed into the cache, so that a bandcampAlbumInfo() or bandcampArtistInfo() request for one
+     * of them completes right away. Requires a cache. Prefetches that are still queued when the
+     * next search completes are dropped in favor of the new ones.
+     *
+     * prefetchStats().hitRate() tells how many of the completed prefetches were served afterwards.
+     */
+    void setPrefetchPolicy(const PrefetchPolicy &policy);
+    PrefetchPolicy prefetchPolicy() const;
+    PrefetchStats prefetchStats() const;
+    void resetPrefetchStats();
+
+    SchedulerStats schedulerStats() const;
+    void resetSchedulerStats();
+
+    RequestId bandcampSearch(const QString &pattern, Priority priority = Interactive);
+
+    /**
+     * Searches the first pages of results at once, optionally restricted to bands, albums or tracks.
+     * All pages are downloaded concurrently, and bandcampRequestCompleted() reports their results
+     * merged in rank order, up to the last page that exists. In streaming mode, each page is
+     * reported through bandcampResultsPartial() as soon as it and all pages before it are complete.
+     */
+    RequestId bandcampSearch(const QString &pattern, ScrapeBandcamp::SearchItemType itemType, int pages = 1,
+                             Priority priority = Interactive);
+    RequestId bandcampArtistInfo(const QString &artistUrl, Priority priority = Interactive);
+    RequestId bandcampAlbumInfo(const QString &albumUrl, Priority priority = Interactive);
+
+    /**
+     * Fetches all tracks of an artist: the band page first, and then the page of each album and
+     * standalone track, as soon as the band page is parsed. The tracks of each release are reported
+     * through bandcampResultsPartial() once its page is parsed, and bandcampRequestCompleted()
+     * finally reports all of them, in the order of the releases on the band page. Releases whose
+     * page fails to load are left out. For an artist with a single release, the band page already
+     * holds its tracks.
+     */
+    RequestId bandcampDiscography(const QString &artistUrl, Priority priority = Interactive);
+
+    RequestId youtubeSearch(const QString &pattern, Priority priority = Interactive);
+
+    /**
+     * Requests the next page of a YouTube search, with a continuation from youtubeNextPageAvailable().
+     * The page is a small JSON document, and is reported through youtubeRequestCompleted() like
+     * the first one. Next pages are never cached.
+     */
+    RequestId youtubeNextPage(const ScrapeYoutube::Continuation &continuation, Priority priority = Interactive);
 
-    RequestId youtubeSearch(const QString &pattern);
+    /**
+     * Drops a queued request, or aborts its download if no other request is waiting for it.
+     * No signal is emitted for a cancelled request. Returns false if the request had
+     * already completed.
+     */
+    bool cancel(RequestId id);
 
 Q_SIGNALS:
     void networkError(RequestId, QNetworkReply::NetworkError error);
     void bandcampRequestCompleted(RequestId id, const ScrapeBandcamp::ResultList &results);
     void youtubeRequestCompleted(RequestId id, const ScrapeYoutube::ResultList &results);
+    void bandcampResultsPartial(RequestId id, const ScrapeBandcamp::ResultList &results);
+    void youtubeResultsPartial(RequestId id, const ScrapeYoutube::ResultList &results);
+
+    /**
+     * Emitted right before youtubeRequestCompleted(), if there is another page of results
+     */
+    void youtubeNextPageAvailable(RequestId id, const ScrapeYoutube::Continuation &continuation);
 
 private Q_SLOTS:
     void onNetworkReplyFinished(QNetworkReply *reply);
+    void processFinishedParses();
 
 private:
-    enum RequestType
+    struct Completion
     {
-        BandcampSearch,
-        BandcampArtistInfo,
-        BandcampAlbumInfo,
-        YoutubeSearch
+        QVector<RequestId> m_ids;   // all requests waiting for this result
+        RequestType m_type;
+        QNetworkReply::NetworkError m_error;
+        ScrapeBandcamp::ResultList m_bandcampResults;
+        ScrapeYoutube::ResultList m_youtubeResults;
+        ScrapeYoutube::Continuation m_continuation;
+        bool m_hasMorePages;        // for BandcampSearch
+        bool m_isSingleRelease;     // for BandcampArtistInfo
+
+        // set if the results are to be stored in the cache
+        QString m_cacheKey;
+        QByteArray m_etag;
+        QByteArray m_lastModified;
     };
 
-    RequestId startRequest(RequestType requestType, const std::string &url);
+    class ParseTask;
 
-    QNetworkAccessManager *m_network;
-    RequestId m_nextRequestId;
+    struct PendingRequest
+    {
+        QVector<RequestId> m_ids;   // identical requests share one download
+        RequestType m_type;
+        Priority m_priority;
+        QNetworkRequest m_request;
+        QByteArray m_postData;      // sent with POST instead of GET, if not empty
+        ScrapeYoutube::Continuation m_continuation;     // the one that is requested, for YoutubeNextPage
+        QString m_host;
+        qint64 m_queuedAt;
+        qint64 m_dispatchedAt;
+        qint64 m_firstByteAt;       // when the response headers arrived, -1 before
+        int m_retries;
+        QPointer<QNetworkReply> m_reply;    // null while queued
+        QString m_cacheKey;
+        bool m_revalidating;
+        QMusicScrapeCache::Entry m_cached;
+
+        // streaming mode
+        QByteArray m_body;
+        QSharedPointer<ScrapeBandcamp::SearchResultStream> m_bandcampStream;
+        QSharedPointer<ScrapeYoutube::SearchResultStream> m_youtubeStream;
+        int m_partialResults;
+        bool m_streamComplete;  // maxResults was reached, and the download aborted
+    };
 
-    struct RunningRequest
+    // one page of a multi-page Bandcamp search, which runs as a request of its own
+    struct SearchPage
     {
         RequestId m_id;
+        bool m_complete;
+        bool m_last;            // failed, empty, or without a link to the next page
+        QNetworkReply::NetworkError m_error;
+        ScrapeBandcamp::ResultList m_results;
+    };
+
+    struct MultiPageSearch
+    {
+        QVector<SearchPage> m_pages;
+        int m_reported;         // leading complete pages that were merged
+    };
+
+    struct Prefetch
+    {
         RequestType m_type;
-        QPointer<QNetworkReply> m_reply;
+        std::string m_url;
+        QString m_cacheKey;
+    };
+
+    // the band page of an artist, and then the page of each of its releases
+    struct Discography
+    {
+        Priority m_priority;
+        RequestId m_artistRequest;          // 0 once complete
+        std::vector<std::string> m_releaseUrls;
+        QVector<RequestId> m_releaseRequests;
+        QVector<ScrapeBandcamp::ResultList> m_tracks;   // by release
+        int m_started;
+        int m_running;
+    };
+
+    struct Host
+    {
+        Host()
+            : m_running(0), m_runningBackground(0), m_window(2.0), m_latencyEwma(0.0), m_latencySamples(0)
+            , m_lastBackoff(-1), m_blockedUntil(0), m_wakeupScheduled(false) {}
+
+        int m_running;
+        int m_runningBackground;
+        QQueue<QString> m_queues[PriorityCount];
+
+        // adaptive rate control
+        double m_window;            // concurrency limit, grows by 1/window per healthy response
+        double m_latencyEwma;       // time to first byte, in msecs
+        int m_latencySamples;
+        qint64 m_lastBackoff;
+        qint64 m_blockedUntil;      // no new downloads until then, from Retry-After
+        bool m_wakeupScheduled;
     };
 
-    QVector<RunningRequest> m_runningHttpRequests;
+    RequestId startRequest(RequestType requestType, const std::string &url, Priority priority,
+                           const ScrapeYoutube::Continuation &continuation = ScrapeYoutube::Continuation());
+    void schedule(const QString &host);
+    void dispatch(const QString &key, Host &host);
+    int connectionLimit(const QString &hostName, const Host &host) const;
+    void updateRate(const QString &hostName, Host &host, bool throttled, qint64 timeToFirstByte);
+    qint64 retryDelay(QNetworkReply *reply, int retries) const;
+    void onReplyReadyRead(QNetworkReply *reply);
+    void emitPartialResults(PendingRequest &request);
+    bool finishStream(PendingRequest &request, const QByteArray &rest, Completion &completion);
+    static void parse(Completion &completion, const QByteArray &data, const std::string &url, ScrapeParser *parser);
+    void searchPageCompleted(RequestId pageId, const Completion &completion);
+    void discographyRequestCompleted(RequestId requestId, const Completion &completion);
+    void continueDiscography(RequestId id, const ScrapeBandcamp::ResultList &newTracks);
+    void prefetch(const ScrapeBandcamp::ResultList &results);
+    void startPrefetches();
+    void dropPrefetches(const QSet<QString> &keep = QSet<QString>());
+    void prefetchCompleted(RequestId id, const Completion &completion);
+    void countPrefetchHit(const std::string &url);
+    void dropRequest(RequestId id);
+    void releaseHeldBack();
+    void queueCompletion(const Completion &completion);
+    void finishParse(const Completion &completion);
+    void complete(const Completion &completion);
+    void emitCompletion(RequestId id, const Completion &completion);
+
+    QNetworkAccessManager *m_network;
+    RequestId m_nextRequestId;
+    ScrapeParser m_parser;
+
+    QPointer<QThreadPool> m_threadPool;
+    ResultOrder m_resultOrder;
+
+    QMusicScrapeCache *m_cache;
+    int m_cacheTtl[RequestTypeCount];
+
+    // started requests whose signal hasn't been emitted yet, and finished ones held back for RequestOrder
+    std::set<RequestId> m_unfinished;
+    QMap<RequestId, QSharedPointer<const Completion>> m_heldBack;
+
+    // shared with the parsing threads
+    QMutex m_parseMutex;
+    QWaitCondition m_parseDone;
+    int m_parsesInFlight;
+    QVector<Completion> m_finishedParses;
+
+    // queued and running downloads, by request type and normalized URL
+    QHash<QString, PendingRequest> m_pendingRequests;
+    QHash<QNetworkReply*, QString> m_replyKeys;
+    QHash<RequestId, QString> m_requestKeys;
+
+    // multi-page searches, and the search that each page request belongs to
+    QHash<RequestId, MultiPageSearch> m_multiPageSearches;
+    QHash<RequestId, RequestId> m_searchPageOwners;
+
+    // discographies, and the discography that each band or release page request belongs to
+    QHash<RequestId, Discography> m_discographies;
+    QHash<RequestId, RequestId> m_discographyOwners;
+    int m_discographyConcurrency;
+
+    // queued and running prefetches, and the cache keys of all prefetched pages that weren't requested yet
+    PrefetchPolicy m_prefetchPolicy;
+    PrefetchStats m_prefetchStats;
+    QQueue<Prefetch> m_prefetchQueue;
+    QHash<RequestId, QString> m_prefetchRequests;
+    QSet<QString> m_runningPrefetchKeys;    // the values of m_prefetchRequests
+    QSet<QString> m_prefetchedKeys;
+
+    QHash<QString, Host> m_hosts;
+    int m_defaultMaxConnections;
+    QHash<QString, int> m_maxConnections;
+    bool m_adaptiveRateControl;
+    int m_maxRetries;
+    bool m_streaming;
+    int m_maxResults;
+
+    QElapsedTimer m_clock;
+    SchedulerStats m_schedulerStats;
 };
 
 Q_DECLARE_METATYPE(ScrapeBandcamp::ResultList)
 Q_DECLARE_METATYPE(ScrapeYoutube::ResultList)
+Q_DECLARE_METATYPE(ScrapeYoutube::Continuation)
 
 #endif // INCLUDE_QMUSICSCRAPE_HPP
@@ -0,0 +1,307 @@
+// Copyright (c) 2020 Wieland Hagen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "qmusicscrapecache.hpp"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QDateTime>
+
+static const quint32 DISK_MAGIC = 0x4d534331;   // "MSC1"
+static const quint32 DISK_VERSION = 5;
+
+static size_t stringCost(const std::string &s)
+{
+    return sizeof(std::string) + s.capacity();
+}
+
+static size_t entryCost(const QString &key, const QMusicScrapeCache::Entry &entry)
+{
+    size_t ret = key.size() * sizeof(QChar) + entry.etag.size() + entry.lastModified.size() + 64
+            + stringCost(entry.youtubeContinuation.token) + stringCost(entry.youtubeContinuation.apiKey)
+            + stringCost(entry.youtubeContinuation.clientVersion);
+    for (const ScrapeBandcamp::Result &result : entry.bandcampResults) {
+        ret += sizeof(result) + stringCost(result.bandName) + stringCost(result.albumName) + stringCost(result.trackName)
+                + stringCost(result.url) + stringCost(result.artUrl) + stringCost(result.mp3url);
+    }
+    for (const ScrapeYoutube::Result &result : entry.youtubeResults) {
+        ret += sizeof(result) + stringCost(result.title) + stringCost(result.url) + stringCost(result.thumbnailUrl)
+                + stringCost(result.playlist);
+    }
+    return ret;
+}
+
+static QDataStream &operator<<(QDataStream &stream, const std::string &s)
+{
+    return stream << QByteArray::fromStdString(s);
+}
+
+static QDataStream &operator>>(QDataStream &stream, std::string &s)
+{
+    QByteArray data;
+    stream >> data;
+    s = data.toStdString();
+    return stream;
+}
+
+QMusicScrapeCache::QMusicScrapeCache(size_t memoryBudget)
+    : m_memoryBudget(memoryBudget)
+    , m_memoryUsage(0)
+{
+    resetStats();
+}
+
+QMusicScrapeCache::~QMusicScrapeCache()
+{
+}
+
+void QMusicScrapeCache::setMemoryBudget(size_t bytes)
+{
+    m_memoryBudget = bytes;
+    evict();
+}
+
+size_t QMusicScrapeCache::memoryBudget() const
+{
+    return m_memoryBudget;
+}
+
+size_t QMusicScrapeCache::memoryUsage() const
+{
+    return m_memoryUsage;
+}
+
+void QMusicScrapeCache::setDiskDirectory(const QString &directory)
+{
+    m_diskDirectory = directory;
+    if (!m_diskDirectory.isEmpty())
+        QDir().mkpath(m_diskDirectory);
+}
+
+QString QMusicScrapeCache::diskDirectory() const
+{
+    return m_diskDirectory;
+}
+
+QString QMusicScrapeCache::normalizedUrl(const QUrl &url)
+{
+    const QUrl normalized = url.adjusted(QUrl::NormalizePathSegments | QUrl::StripTrailingSlash | QUrl::RemoveFragment);
+    return normalized.toString(QUrl::FullyEncoded);
+}
+
+QMusicScrapeCache::Lookup QMusicScrapeCache::lookup(const QString &key, Entry &entry)
+{
+    Node *node = findInMemory(key);
+    if (node) {
+        entry = node->entry;
+    }
+    else if (readFromDisk(key, entry)) {
+        m_stats.diskReads++;
+        insertInMemory(key, entry);
+    }
+    else {
+        m_stats.misses++;
+        return Miss;
+    }
+
+    if (entry.expires > QDateTime::currentMSecsSinceEpoch()) {
+        m_stats.hits++;
+        return Fresh;
+    }
+    return Stale;
+}
+
+bool QMusicScrapeCache::isFresh(const QString &key) const
+{
+    const auto it = m_nodes.find(key);
+    return it != m_nodes.end() && it->entry.expires > QDateTime::currentMSecsSinceEpoch();
+}
+
+void QMusicScrapeCache::insert(const QString &key, const Entry &entry)
+{
+    insertInMemory(key, entry);
+    writeToDisk(key, entry);
+}
+
+void QMusicScrapeCache::revalidated(const QString &key, const Entry &entry)
+{
+    m_stats.revalidations++;
+    insert(key, entry);
+}
+
+void QMusicScrapeCache::clear()
+{
+    m_nodes.clear();
+    m_lru.clear();
+    m_memoryUsage = 0;
+
+    if (!m_diskDirectory.isEmpty()) {
+        QDir dir(m_diskDirectory);
+        for (const QString &file : dir.entryList(QStringList() << "*.cache", QDir::Files))
+            dir.remove(file);
+    }
+}
+
+QMusicScrapeCache::Stats QMusicScrapeCache::stats() const
+{
+    return m_stats;
+}
+
+void QMusicScrapeCache::resetStats()
+{
+    m_stats = Stats{0, 0, 0, 0, 0};
+}
+
+QMusicScrapeCache::Node *QMusicScrapeCache::findInMemory(const QString &key)
+{
+    const auto it = m_nodes.find(key);
+    if (it == m_nodes.end())
+        return nullptr;
+
+    // move to the front of the LRU list
+    m_lru.splice(m_lru.begin(), m_lru, it->lruPosition);
+    return &it.value();
+}
+
+void QMusicScrapeCache::insertInMemory(const QString &key, const Entry &entry)
+{
+    const auto it = m_nodes.find(key);
+    if (it != m_nodes.end()) {
+        m_memoryUsage -= it->cost;
+        m_lru.erase(it->lruPosition);
+        m_nodes.erase(it);
+    }
+
+    Node node;
+    node.entry = entry;
+    node.cost = entryCost(key, entry);
+    if (node.cost > m_memoryBudget)
+        return;
+
+    m_lru.push_front(key);
+    node.lruPosition = m_lru.begin();
+    m_nodes.insert(key, node);
+    m_memoryUsage += node.cost;
+    evict();
+}
+
+void QMusicScrapeCache::evict()
+{
+    while (m_memoryUsage > m_memoryBudget && !m_lru.empty()) {
+        const auto it = m_nodes.find(m_lru.back());
+        m_memoryUsage -= it->cost;
+        m_nodes.erase(it);
+        m_lru.pop_back();
+        m_stats.evictions++;
+    }
+}
+
+QString QMusicScrapeCache::diskPath(const QString &key) const
+{
+    const QByteArray hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return m_diskDirectory + "/" + QString::fromLatin1(hash) + ".cache";
+}
+
+bool QMusicScrapeCache::readFromDisk(const QString &key, Entry &entry) const
+{
+    if (m_diskDirectory.isEmpty())
+        return false;
+
+    QFile file(diskPath(key));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic, version;
+    QString storedKey;
+    stream >> magic >> version;
+    if (magic != DISK_MAGIC || version != DISK_VERSION)
+        return false;
+    stream >> storedKey;
+    if (storedKey != key)
+        return false;
+
+    quint32 bandcampCount, youtubeCount;
+    stream >> entry.etag >> entry.lastModified >> entry.expires;
+
+    stream >> bandcampCount;
+    entry.bandcampResults.clear();
+    for (quint32 i = 0; i < bandcampCount && stream.status() == QDataStream::Ok; ++i) {
+        ScrapeBandcamp::Result result;
+        qint32 type, trackNum, mp3duration;
+        stream >> type >> result.bandName >> result.albumName >> result.trackName >> trackNum
+               >> result.url >> result.artUrl >> result.mp3url >> mp3duration;
+        result.resultType = (ScrapeBandcamp::Result::Type) type;
+        result.trackNum = trackNum;
+        result.mp3duration = mp3duration;
+        entry.bandcampResults.push_back(result);
+    }
+
+    stream >> youtubeCount;
+    entry.youtubeResults.clear();
+    for (quint32 i = 0; i < youtubeCount && stream.status() == QDataStream::Ok; ++i) {
+        ScrapeYoutube::Result result;
+        qint32 type;
+        stream >> result.title >> result.url >> result.thumbnailUrl >> result.playlist >> type;
+        result.resultType = (ScrapeYoutube::Result::Type) type;
+        entry.youtubeResults.push_back(result);
+    }
+
+    stream >> entry.youtubeContinuation.token >> entry.youtubeContinuation.apiKey
+           >> entry.youtubeContinuation.clientVersion >> entry.bandcampSingleRelease >> entry.bandcampHasMorePages;
+
+    return stream.status() == QDataStream::Ok;
+}
+
+void QMusicScrapeCache::writeToDisk(const QString &key, const Entry &entry) const
+{
+    if (m_diskDirectory.isEmpty())
+        return;
+
+    QSaveFile file(diskPath(key));
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    stream << DISK_MAGIC << DISK_VERSION << key << entry.etag << entry.lastModified << entry.expires;
+
+    stream << (quint32) entry.bandcampResults.size();
+    for (const ScrapeBandcamp::Result &result : entry.bandcampResults) {
+        stream << (qint32) result.resultType << result.bandName << result.albumName << result.trackName
+               << (qint32) result.trackNum << result.url << result.artUrl << result.mp3url << (qint32) result.mp3duration;
+    }
+
+    stream << (quint32) entry.youtubeResults.size();
+    for (const ScrapeYoutube::Result &result : entry.youtubeResults)
+        stream << result.title << result.url << result.thumbnailUrl << result.playlist << (qint32) result.resultType;
+
+    stream << entry.youtubeContinuation.token << entry.youtubeContinuation.apiKey
+           << entry.youtubeContinuation.clientVersion << entry.bandcampSingleRelease << entry.bandcampHasMorePages;
+
+    file.commit();
+}
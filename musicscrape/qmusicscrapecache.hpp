@@ -0,0 +1,151 @@
+// Copyright (c) 2020 Wieland Hagen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef INCLUDE_QMUSICSCRAPECACHE_HPP
+#define INCLUDE_QMUSICSCRAPECACHE_HPP
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QUrl>
+
+#include <list>
+
+#include "musicscrape/musicscrape.hpp"
+
+/**
+ * Two-tier cache of parsed results, keyed by normalized URL, for use with QMusicScrape::setCache().
+ *
+ * The memory tier is an LRU list bounded by an estimate of the memory used by the results.
+ * If a disk directory is set, every entry is also written there, and entries that were evicted
+ * from memory (or stored by an earlier run) are loaded back from disk on demand.
+ *
+ * Not thread-safe, use from the thread that owns the QMusicScrape.
+ */
+class QMusicScrapeCache
+{
+public:
+    struct Entry
+    {
+        ScrapeBandcamp::ResultList bandcampResults;
+        ScrapeYoutube::ResultList youtubeResults;
+        ScrapeYoutube::Continuation youtubeContinuation;
+        bool bandcampSingleRelease;     // for artist pages, whose results are then the tracks of that release
+        bool bandcampHasMorePages;      // for search pages, whether they link to a next page
+
+        /**
+         * Validators of the response, sent along when revalidating a stale entry
+         */
+        QByteArray etag;
+        QByteArray lastModified;
+
+        /**
+         * Time after which the entry needs revalidation, in msecs since epoch
+         */
+        qint64 expires;
+    };
+
+    enum Lookup
+    {
+        Miss,
+        Fresh,
+        Stale
+    };
+
+    struct Stats
+    {
+        quint64 hits;           // fresh entries, served without network access
+        quint64 misses;         // not cached at all
+        quint64 revalidations;  // stale entries that were confirmed by a 304 response
+        quint64 evictions;      // entries dropped from memory to stay within the budget
+        quint64 diskReads;      // entries loaded from the disk store
+    };
+
+    QMusicScrapeCache(size_t memoryBudget = 8 * 1024 * 1024);
+    ~QMusicScrapeCache();
+
+    void setMemoryBudget(size_t bytes);
+    size_t memoryBudget() const;
+    size_t memoryUsage() const;
+
+    /**
+     * Enables the disk store in the given directory, which is created if needed.
+     * An empty string keeps the cache in memory only.
+     */
+    void setDiskDirectory(const QString &directory);
+    QString diskDirectory() const;
+
+    static QString normalizedUrl(const QUrl &url);
+
+    /**
+     * Looks up the entry for the given key. Fills in entry for Fresh and Stale results.
+     */
+    Lookup lookup(const QString &key, Entry &entry);
+
+    /**
+     * Whether a fresh entry for the key is held in memory. Unlike lookup(), this doesn't touch
+     * the disk store, the LRU order or the stats.
+     */
+    bool isFresh(const QString &key) const;
+
+    void insert(const QString &key, const Entry &entry);
+
+    /**
+     * Stores a stale entry again with a new expiry time, after the server confirmed that it didn't change
+     */
+    void revalidated(const QString &key, const Entry &entry);
+
+    /**
+     * Drops all entries from memory and from the disk store
+     */
+    void clear();
+
+    Stats stats() const;
+    void resetStats();
+
+private:
+    QMusicScrapeCache(const QMusicScrapeCache &) = delete;
+    QMusicScrapeCache &operator=(const QMusicScrapeCache &) = delete;
+
+    struct Node
+    {
+        Entry entry;
+        size_t cost;
+        std::list<QString>::iterator lruPosition;
+    };
+
+    Node *findInMemory(const QString &key);
+    void insertInMemory(const QString &key, const Entry &entry);
+    void evict();
+
+    QString diskPath(const QString &key) const;
+    bool readFromDisk(const QString &key, Entry &entry) const;
+    void writeToDisk(const QString &key, const Entry &entry) const;
+
+    QHash<QString, Node> m_nodes;
+    std::list<QString> m_lru;       // most recently used first
+    size_t m_memoryBudget;
+    size_t m_memoryUsage;
+    QString m_diskDirectory;
+    Stats m_stats;
+};
+
+#endif // INCLUDE_QMUSICSCRAPECACHE_HPP
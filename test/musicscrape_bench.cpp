@@ -0,0 +1,727 @@
+// Copyright (c) 2020 Wieland Hagen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Offline benchmark: runs all parsing entry points over the synthetic pages in test/corpus/,
+// and reports throughput, latency, allocations (with glibc) and peak memory (on POSIX systems). Exits with a non-zero status
+// if a page doesn't produce the expected number of results. --verify and --batch compare the
+// results of the other parsers with those of the full HTML parser, and of BatchParser.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define BENCH_PEAK_RSS
+#endif
+
+#include "musicscrape.hpp"
+#include "musicscrapebatch.hpp"
+#include "musicscrapecompact.hpp"
+#include "musicscrapesnapshot.hpp"
+
+#ifndef MUSICSCRAPE_CORPUS_DIR
+#define MUSICSCRAPE_CORPUS_DIR "test/corpus"
+#endif
+
+using std::string;
+using std::vector;
+
+static std::atomic<size_t> s_allocations(0);
+
+// the sanitizers replace malloc() themselves
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define BENCH_COUNT_ALLOCATIONS
+#endif
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+// Count every heap allocation, including the ones Gumbo makes with plain malloc()
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+}
+#endif
+
+struct Page
+{
+    string kind;
+    string file;
+    size_t expectedResults;
+    string baseUrl;
+    string html;
+};
+
+struct Measurement
+{
+    string name;
+    size_t bytes;
+    vector<double> latencies;   // in microseconds
+    size_t allocations;
+};
+
+static bool readFile(const string &path, string &dst)
+{
+    std::ifstream file(path.data(), std::ios::binary);
+    if (!file)
+        return false;
+    std::ostringstream stream;
+    stream << file.rdbuf();
+    dst = stream.str();
+    return true;
+}
+
+static vector<Page> readCorpus(const string &dir)
+{
+    vector<Page> ret;
+
+    string manifest;
+    if (!readFile(dir + "/corpus.txt", manifest)) {
+        std::cerr << "Can't read " << dir << "/corpus.txt" << std::endl;
+        return ret;
+    }
+
+    std::istringstream lines(manifest);
+    string line;
+    while (std::getline(lines, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        Page page;
+        std::istringstream fields(line);
+        if (!(fields >> page.kind >> page.file >> page.expectedResults))
+            continue;
+        fields >> page.baseUrl;
+
+        if (!readFile(dir + "/" + page.file, page.html)) {
+            std::cerr << "Can't read " << dir << "/" << page.file << std::endl;
+            continue;
+        }
+        ret.push_back(page);
+    }
+
+    return ret;
+}
+
+static string entryPoint(const Page &page)
+{
+    if (page.kind == "bandcamp-search")
+        return "ScrapeBandcamp::searchResult";
+    if (page.kind == "bandcamp-band")
+        return "ScrapeBandcamp::bandInfoResult";
+    if (page.kind == "bandcamp-album")
+        return "ScrapeBandcamp::albumInfo";
+    if (page.kind == "youtube-search")
+        return "ScrapeYoutube::searchResult";
+    if (page.kind == "youtube-continuation")
+        return "ScrapeYoutube::continuationResult";
+    return "?";
+}
+
+static size_t parsePage(const Page &page, ScrapeParser *parser)
+{
+    const char *html = page.html.data();
+    const size_t length = page.html.size();
+
+    if (page.kind == "bandcamp-search")
+        return ScrapeBandcamp::searchResult(html, length, parser).size();
+    if (page.kind == "bandcamp-band")
+        return ScrapeBandcamp::bandInfoResult(page.baseUrl, html, length, nullptr, parser).size();
+    if (page.kind == "bandcamp-album")
+        return ScrapeBandcamp::albumInfo(html, length, parser).size();
+    if (page.kind == "youtube-search")
+        return ScrapeYoutube::searchResult(html, length, parser).size();
+    if (page.kind == "youtube-continuation")
+        return ScrapeYoutube::continuationResult(html, length, parser).size();
+    return 0;
+}
+
+static const size_t STREAM_CHUNK_SIZE = 16 * 1024;
+
+static bool isStreamable(const Page &page)
+{
+    return page.kind == "bandcamp-search" || page.kind == "youtube-search";
+}
+
+// feeds the page to the incremental parser in network-sized chunks
+template <class Stream>
+static size_t streamPage(const Page &page, Stream &stream)
+{
+    for (size_t pos = 0; pos < page.html.size(); pos += STREAM_CHUNK_SIZE)
+        stream.feed(page.html.data() + pos, std::min(STREAM_CHUNK_SIZE, page.html.size() - pos));
+    stream.finish();
+    return stream.results().size();
+}
+
+static size_t streamPage(const Page &page, ScrapeParser *parser)
+{
+    if (page.kind == "bandcamp-search") {
+        ScrapeBandcamp::SearchResultStream stream(parser);
+        return streamPage(page, stream);
+    }
+    if (page.kind == "youtube-search") {
+        ScrapeYoutube::SearchResultStream stream(parser);
+        return streamPage(page, stream);
+    }
+    return 0;
+}
+
+static size_t stringMemory(const string &s)
+{
+    // heap block of strings that don't fit into the small string buffer
+    return (s.capacity() > sizeof(string) - 1) ? s.capacity() + 1 : 0;
+}
+
+static size_t resultListMemory(const ScrapeBandcamp::ResultList &results)
+{
+    size_t ret = results.capacity() * sizeof(ScrapeBandcamp::Result);
+    for (const ScrapeBandcamp::Result &r : results) {
+        ret += stringMemory(r.bandName) + stringMemory(r.albumName) + stringMemory(r.trackName)
+             + stringMemory(r.url) + stringMemory(r.artUrl) + stringMemory(r.mp3url);
+    }
+    return ret;
+}
+
+static bool sameResults(const ScrapeBandcamp::ResultList &a, const ScrapeBandcamp::ResultList &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].resultType != b[i].resultType || a[i].bandName != b[i].bandName
+                || a[i].albumName != b[i].albumName || a[i].trackName != b[i].trackName
+                || a[i].trackNum != b[i].trackNum || a[i].url != b[i].url || a[i].artUrl != b[i].artUrl
+                || a[i].mp3url != b[i].mp3url || a[i].mp3duration != b[i].mp3duration)
+            return false;
+    }
+    return true;
+}
+
+static bool sameResults(const ScrapeYoutube::ResultList &a, const ScrapeYoutube::ResultList &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].resultType != b[i].resultType || a[i].title != b[i].title || a[i].url != b[i].url
+                || a[i].thumbnailUrl != b[i].thumbnailUrl || a[i].playlist != b[i].playlist)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Feeds a search page to its SearchResultStream, and compares the results with those of
+ * searchResult() for the same options
+ */
+static bool sameStreamResults(const Page &page, const ScrapeOptions &options)
+{
+    ScrapeParser parser;
+    parser.setOptions(options);
+    const char *html = page.html.data();
+    const size_t length = page.html.size();
+    if (page.kind == "bandcamp-search") {
+        ScrapeBandcamp::SearchResultStream stream(&parser);
+        streamPage(page, stream);
+        bool hasMorePages = false;
+        const ScrapeBandcamp::ResultList results = ScrapeBandcamp::searchResult(html, length, &parser, &hasMorePages);
+        return sameResults(stream.results(), results) && stream.hasMorePages() == hasMorePages;
+    }
+    if (page.kind == "youtube-search") {
+        ScrapeYoutube::SearchResultStream stream(&parser);
+        streamPage(page, stream);
+        const ScrapeYoutube::ResultList results = ScrapeYoutube::searchResult(html, length, &parser);
+        return sameResults(stream.results(), results);
+    }
+    return true;
+}
+
+/**
+ * Parses the page with the fast paths, the full tree and the tokenizer, and compares all result
+ * fields of the fast paths and the tokenizer with those of the tree. Each pass starts with a new
+ * ScrapeParser, so that its buffers have to grow for large pages. Search pages are also compared
+ * against their streams.
+ */
+static bool verifyPage(const Page &page)
+{
+    const char *html = page.html.data();
+    const size_t length = page.html.size();
+
+    // fast paths, DOM, tokenizer
+    ScrapeOptions options;
+    ScrapeBandcamp::ResultList bandcamp[3];
+    ScrapeYoutube::ResultList youtube[3];
+    ScrapeYoutube::Continuation continuation[3];
+    bool hasMorePages[3] = {false, false, false};
+    bool fallback = false;
+    for (int pass = 0; pass < 3; ++pass) {
+        ScrapeParser parser;
+        options.fastPaths = (pass == 0);
+        options.htmlBackend = (pass == 2) ? HtmlTokenizer : HtmlTree;
+        parser.setOptions(options);
+        parser.setCollectStats(true);
+        if (page.kind == "bandcamp-search")
+            bandcamp[pass] = ScrapeBandcamp::searchResult(html, length, &parser, &hasMorePages[pass]);
+        else if (page.kind == "bandcamp-band")
+            bandcamp[pass] = ScrapeBandcamp::bandInfoResult(page.baseUrl, html, length, nullptr, &parser);
+        else if (page.kind == "bandcamp-album")
+            bandcamp[pass] = ScrapeBandcamp::albumInfo(html, length, &parser);
+        else if (page.kind == "youtube-search")
+            youtube[pass] = ScrapeYoutube::searchResult(html, length, &parser, &continuation[pass]);
+        else if (page.kind == "youtube-continuation")
+            youtube[pass] = ScrapeYoutube::continuationResult(html, length, &parser, &continuation[pass]);
+        if (pass == 0)
+            fallback = parser.stats().fallback;
+    }
+
+    const auto samePasses = [&](int a, int b) {
+        return sameResults(bandcamp[a], bandcamp[b]) && sameResults(youtube[a], youtube[b])
+                && continuation[a].token == continuation[b].token
+                && continuation[a].apiKey == continuation[b].apiKey
+                && continuation[a].clientVersion == continuation[b].clientVersion
+                && hasMorePages[a] == hasMorePages[b];
+    };
+
+    // both HTML backends against the full tree, which also has to find the next page
+    bool fastPathSame = samePasses(0, 1);
+    const bool tokenizerSame = samePasses(2, 1);
+    if (page.kind == "youtube-search" || page.kind == "youtube-continuation")
+        fastPathSame = fastPathSame && continuation[1].isValid();
+    if (page.kind == "bandcamp-search")
+        fastPathSame = fastPathSame && hasMorePages[1];
+
+    // the streams, with all results, and with a limit and a subset of the fields
+    ScrapeOptions limited;
+    limited.maxResults = 3;
+    limited.fields = FieldUrl | FieldTitle;
+    const bool streamSame = sameStreamResults(page, ScrapeOptions()) && sameStreamResults(page, limited);
+
+    const auto verdict = [](bool same) { return same ? "identical" : "MISMATCH"; };
+    printf("%-58s %9s %9s %9s %8s\n", (entryPoint(page) + " " + page.file).data(), verdict(fastPathSame),
+           verdict(tokenizerSame), isStreamable(page) ? verdict(streamSame) : "-", fallback ? "yes" : "no");
+    const bool same = fastPathSame && tokenizerSame && streamSame;
+    return same;
+}
+
+static bool batchKind(const Page &page, ScrapeBatch::PageKind *kind)
+{
+    if (page.kind == "bandcamp-search")
+        *kind = ScrapeBatch::BandcampSearch;
+    else if (page.kind == "bandcamp-band")
+        *kind = ScrapeBatch::BandcampBandInfo;
+    else if (page.kind == "bandcamp-album")
+        *kind = ScrapeBatch::BandcampAlbum;
+    else if (page.kind == "youtube-search")
+        *kind = ScrapeBatch::YoutubeSearch;
+    else
+        return false;
+    return true;
+}
+
+// what BatchParser should return for the job, parsed on the calling thread
+static ScrapeBatch::JobResult sequentialResult(const ScrapeBatch::Job &job, ScrapeParser *parser)
+{
+    ScrapeBatch::JobResult ret;
+    ret.kind = job.kind;
+    ret.isSingleRelease = false;
+    switch (job.kind) {
+    case ScrapeBatch::BandcampSearch:
+        ret.bandcamp = ScrapeBandcamp::searchResult(job.html, job.length, parser);
+        break;
+    case ScrapeBatch::BandcampBandInfo:
+        ret.bandcamp = ScrapeBandcamp::bandInfoResult(job.baseUrl, job.html, job.length, &ret.isSingleRelease, parser);
+        break;
+    case ScrapeBatch::BandcampAlbum:
+        ret.bandcamp = ScrapeBandcamp::albumInfo(job.html, job.length, parser);
+        break;
+    case ScrapeBatch::YoutubeSearch:
+        ret.youtube = ScrapeYoutube::searchResult(job.html, job.length, parser);
+        break;
+    }
+    return ret;
+}
+
+static bool sameResults(const ScrapeBatch::JobResult &a, const ScrapeBatch::JobResult &b)
+{
+    return a.kind == b.kind && sameResults(a.bandcamp, b.bandcamp) && sameResults(a.youtube, b.youtube)
+            && a.isSingleRelease == b.isSingleRelease;
+}
+
+static bool sameResults(const vector<ScrapeBatch::JobResult> &a, const vector<ScrapeBatch::JobResult> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (!sameResults(a[i], b[i]))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Parses the corpus with a BatchParser of the given size, and compares the results with those of
+ * a sequential ScrapeParser: in input order, through the completion callback, from several
+ * threads sharing the pool, and with a callback that throws halfway through the batch.
+ */
+static bool verifyBatch(const vector<Page> &pages, unsigned threadCount)
+{
+    // every page several times, so that there is work to steal
+    vector<ScrapeBatch::Job> jobs;
+    for (int round = 0; round < 8; ++round) {
+        for (const Page &page : pages) {
+            ScrapeBatch::Job job;
+            if (!batchKind(page, &job.kind))
+                continue;
+            job.html = page.html.data();
+            job.length = page.html.size();
+            job.baseUrl = page.baseUrl;
+            jobs.push_back(job);
+        }
+    }
+
+    ScrapeOptions limited;
+    limited.maxResults = 3;
+    limited.fields = FieldUrl | FieldTitle;
+
+    vector<ScrapeBatch::JobResult> expected, expectedLimited;
+    {
+        ScrapeParser parser, limitedParser;
+        limitedParser.setOptions(limited);
+        for (const ScrapeBatch::Job &job : jobs) {
+            expected.push_back(sequentialResult(job, &parser));
+            expectedLimited.push_back(sequentialResult(job, &limitedParser));
+        }
+    }
+
+    ScrapeBatch::BatchParser batch(threadCount);
+
+    // in input order, with and without options
+    const bool ordered = sameResults(batch.parse(jobs), expected);
+    const bool optionsSame = sameResults(batch.parse(jobs, limited), expectedLimited);
+
+    // every job is reported exactly once
+    vector<int> seen(jobs.size(), 0);
+    bool callbackSame = true;
+    std::mutex mutex;
+    batch.parse(jobs.data(), jobs.size(), [&](size_t index, ScrapeBatch::JobResult &result) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (index < seen.size()) {
+            seen[index]++;
+            callbackSame = callbackSame && sameResults(result, expected[index]);
+        } else {
+            callbackSame = false;
+        }
+    });
+    callbackSame = callbackSame && std::count(seen.begin(), seen.end(), 1) == (int) seen.size();
+
+    // several batches at once on the same workers
+    const int CONCURRENT_BATCHES = 3;
+    bool concurrentSame[CONCURRENT_BATCHES];
+    vector<std::thread> threads;
+    for (int i = 0; i < CONCURRENT_BATCHES; ++i) {
+        threads.emplace_back([&, i]() {
+            concurrentSame[i] = sameResults(batch.parse(jobs, (i % 2) ? limited : ScrapeOptions()),
+                                            (i % 2) ? expectedLimited : expected);
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    const bool concurrent = std::count(concurrentSame, concurrentSame + CONCURRENT_BATCHES, true) == CONCURRENT_BATCHES;
+
+    // an exception from the callback comes out of parse(), and the pool stays usable
+    bool rethrown = false;
+    try {
+        batch.parse(jobs.data(), jobs.size(), [&](size_t index, ScrapeBatch::JobResult &) {
+            if (index == jobs.size() / 2)
+                throw std::runtime_error("callback failed");
+        });
+    } catch (const std::runtime_error &) {
+        rethrown = true;
+    }
+    rethrown = rethrown && sameResults(batch.parse(jobs), expected);
+
+    const auto verdict = [](bool same) { return same ? "identical" : "MISMATCH"; };
+    printf("BatchParser, %u threads, %-34zu %9s %9s %9s %10s %9s\n", batch.threadCount(), jobs.size(),
+           verdict(ordered), verdict(optionsSame), verdict(callbackSame), verdict(concurrent),
+           rethrown ? "rethrown" : "MISSING");
+    return ordered && optionsSame && callbackSame && concurrent && rethrown;
+}
+
+static double percentile(vector<double> values, double p)
+{
+    if (values.empty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    const size_t idx = std::min(values.size() - 1, (size_t) (p * values.size()));
+    return values[idx];
+}
+
+static void printMeasurement(const Measurement &m, size_t iterations)
+{
+    double total = 0.0;
+    for (double latency : m.latencies)
+        total += latency;
+
+    const double seconds = total / 1e6;
+    const double pagesPerSecond = m.latencies.size() / seconds;
+    const double mbPerSecond = (m.bytes * m.latencies.size()) / (1024.0 * 1024.0) / seconds;
+
+    char allocations[32] = "-";
+#ifdef BENCH_COUNT_ALLOCATIONS
+    snprintf(allocations, sizeof(allocations), "%.1f", (double) m.allocations / iterations);
+#endif
+
+    printf("%-58s %9.1f %8.1f %9.1f %9.1f %10s\n", m.name.data(), pagesPerSecond, mbPerSecond,
+           percentile(m.latencies, 0.5), percentile(m.latencies, 0.99), allocations);
+}
+
+int main(int argc, char **argv)
+{
+    string corpusDir = MUSICSCRAPE_CORPUS_DIR;
+    size_t iterations = 200;
+    bool verify = false;
+    bool batch = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--corpus") && i + 1 < argc) {
+            corpusDir = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+            iterations = std::max(1, atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--verify")) {
+            verify = true;
+        }
+        else if (!strcmp(argv[i], "--batch")) {
+            batch = true;
+        }
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--corpus DIR] [--iterations N] [--verify] [--batch]" << std::endl;
+            return 2;
+        }
+    }
+
+    const vector<Page> pages = readCorpus(corpusDir);
+    if (pages.empty())
+        return 1;
+
+    int failures = 0;
+    ScrapeParser parser;
+
+    // differential test of the fast paths, the tokenizer and the streams against the full HTML parser
+    if (verify) {
+        printf("%-58s %9s %9s %9s %8s\n", "results vs. DOM", "fast path", "tokenizer", "stream", "fallback");
+        for (const Page &page : pages) {
+            if (!verifyPage(page))
+                failures++;
+        }
+        return failures ? 1 : 0;
+    }
+
+    // BatchParser against a sequential ScrapeParser, with several pool sizes
+    if (batch) {
+        printf("%-58s %9s %9s %9s %10s %9s\n", "batch vs. sequential, jobs", "ordered", "options", "callback",
+               "concurrent", "throwing");
+        for (unsigned threadCount : {1u, 2u, 4u, 8u}) {
+            if (!verifyBatch(pages, threadCount))
+                failures++;
+        }
+        return failures ? 1 : 0;
+    }
+
+    printf("%-58s %9s %8s %9s %9s %10s\n", "", "pages/s", "MB/s", "p50 [us]", "p99 [us]", "allocs/pg");
+
+    for (const Page &page : pages) {
+        for (int variant = 0; variant < 3; ++variant) {
+            const bool streamed = (variant == 2);
+            if (streamed && !isStreamable(page))
+                continue;
+            ScrapeParser *currentParser = (variant > 0) ? &parser : nullptr;
+
+            Measurement m;
+            m.name = entryPoint(page) + " " + page.file + (streamed ? " (stream)" : currentParser ? " (parser)" : "");
+            m.bytes = page.html.size();
+            m.allocations = 0;
+
+            // warm up, and check results
+            const size_t results = streamed ? streamPage(page, currentParser) : parsePage(page, currentParser);
+            if (results != page.expectedResults) {
+                std::cerr << m.name << ": expected " << page.expectedResults << " results, got " << results << std::endl;
+                failures++;
+            }
+
+            for (size_t i = 0; i < iterations; ++i) {
+                const size_t allocationsBefore = s_allocations.load();
+                const auto start = std::chrono::steady_clock::now();
+                if (streamed)
+                    streamPage(page, currentParser);
+                else
+                    parsePage(page, currentParser);
+                const auto end = std::chrono::steady_clock::now();
+                m.allocations += s_allocations.load() - allocationsBefore;
+                m.latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+            }
+
+            printMeasurement(m, iterations);
+        }
+    }
+
+    // phase breakdown of a single warm parse per page
+    printf("\n%-58s %9s %9s %9s %9s %7s %7s %8s\n", "", "html [us]", "tree [us]", "json [us]", "asm [us]",
+           "nodes", "skipped", "fallback");
+    parser.setCollectStats(true);
+    for (const Page &page : pages) {
+        parsePage(page, &parser);
+        const ScrapeStats &stats = parser.stats();
+        const string name = entryPoint(page) + " " + page.file;
+        printf("%-58s %9.1f %9.1f %9.1f %9.1f %7zu %7zu %8s\n", name.data(),
+               stats.htmlParseNs / 1e3, stats.traversalNs / 1e3, stats.jsonParseNs / 1e3, stats.assemblyNs / 1e3,
+               stats.nodeCount, stats.skippedItems, stats.fallback ? "yes" : "no");
+    }
+    parser.setCollectStats(false);
+
+    // first few results with URL and title only, as for a type-ahead search
+    ScrapeOptions options;
+    options.maxResults = 5;
+    options.fields = FieldUrl | FieldTitle;
+    parser.setOptions(options);
+    printf("\n%-58s %9s %9s\n", "first 5, url+title", "p50 [us]", "full [us]");
+    for (const Page &page : pages) {
+        const string name = entryPoint(page) + " " + page.file;
+        const size_t results = parsePage(page, &parser);
+        if (results != std::min(page.expectedResults, options.maxResults)) {
+            std::cerr << name << " (first 5): expected " << std::min(page.expectedResults, options.maxResults)
+                      << " results, got " << results << std::endl;
+            failures++;
+        }
+
+        vector<double> limited, full;
+        for (size_t i = 0; i < iterations; ++i) {
+            for (int pass = 0; pass < 2; ++pass) {
+                parser.setOptions(pass ? ScrapeOptions() : options);
+                const auto start = std::chrono::steady_clock::now();
+                parsePage(page, &parser);
+                const auto end = std::chrono::steady_clock::now();
+                (pass ? full : limited).push_back(std::chrono::duration<double, std::micro>(end - start).count());
+            }
+        }
+        parser.setOptions(options);
+        printf("%-58s %9.1f %9.1f\n", name.data(), percentile(limited, 0.5), percentile(full, 0.5));
+    }
+    parser.setOptions(ScrapeOptions());
+
+    // memory held by the parsed results, as ResultList and as CompactResultList
+    printf("\n%-58s %9s %9s\n", "bytes/result", "list", "compact");
+    ScrapeBandcamp::ResultList allBandcamp;
+    for (const Page &page : pages) {
+        if (page.kind == "youtube-search" || page.kind == "youtube-continuation")
+            continue;
+        const string name = entryPoint(page) + " " + page.file;
+        ScrapeBandcamp::ResultList results;
+        if (page.kind == "bandcamp-search")
+            results = ScrapeBandcamp::searchResult(page.html.data(), page.html.size(), &parser);
+        else if (page.kind == "bandcamp-band")
+            results = ScrapeBandcamp::bandInfoResult(page.baseUrl, page.html.data(), page.html.size(), nullptr, &parser);
+        else
+            results = ScrapeBandcamp::albumInfo(page.html.data(), page.html.size(), &parser);
+        if (results.empty())
+            continue;
+
+        ScrapeBandcamp::CompactResultList compact(results);
+        if (!sameResults(compact.toResultList(), results)) {
+            std::cerr << name << ": CompactResultList doesn't reproduce the results" << std::endl;
+            failures++;
+        }
+        compact.squeeze();
+        printf("%-58s %9zu %9zu\n", name.data(), resultListMemory(results) / results.size(),
+               compact.memoryUsage() / compact.size());
+
+        allBandcamp.insert(allBandcamp.end(), results.begin(), results.end());
+    }
+
+    // snapshot round trip of all Bandcamp results
+    const char *snapshotPath = "musicscrape_bench.snapshot";
+    std::remove(snapshotPath);
+    {
+        ScrapeSnapshot::Writer writer;
+        if (!writer.open(snapshotPath, ScrapeSnapshot::Bandcamp) || !writer.append(allBandcamp)) {
+            std::cerr << "Snapshot: " << writer.errorString() << std::endl;
+            failures++;
+        }
+    }
+    {
+        const auto start = std::chrono::steady_clock::now();
+        ScrapeSnapshot::Reader reader;
+        const bool opened = reader.open(snapshotPath);
+        const auto end = std::chrono::steady_clock::now();
+        if (!opened || !sameResults(reader.bandcampResults(), allBandcamp)) {
+            std::cerr << "Snapshot doesn't reproduce the results: " << reader.errorString() << std::endl;
+            failures++;
+        }
+        printf("\nsnapshot: %zu results, opened in %.1f us\n", reader.size(),
+               std::chrono::duration<double, std::micro>(end - start).count());
+    }
+    std::remove(snapshotPath);
+
+#ifdef BENCH_PEAK_RSS
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    usage.ru_maxrss /= 1024;    // in bytes instead of KiB
+#endif
+    printf("\npeak RSS: %ld KiB\n", (long) usage.ru_maxrss);
+#endif
+
+    return failures ? 1 : 0;
+}
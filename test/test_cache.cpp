@@ -0,0 +1,120 @@
+// Copyright (c) 2020 Wieland Hagen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Runs QMusicScrape with a cache against a local HTTP server that sends an ETag, and checks that
+// a stale entry is revalidated with If-None-Match, that the 304 response completes the request
+// with the cached results, and that the revalidated entry is then served without network access.
+
+#include "qmusicscrape.hpp"
+#include "testserver.hpp"
+
+static const size_t EXPECTED_TRACKS = 12;
+static const char *ETAG = "\"cinder-1\"";
+
+class Test : public TestCase
+{
+public:
+    Test(const QByteArray &page)
+        : m_page(page)
+        , m_server([this](const TestServer::Request &request) { return respond(request); })
+        , m_step(0)
+        , m_full(0)
+        , m_notModified(0)
+    {
+        connect(&m_musicScrape, &QMusicScrape::bandcampRequestCompleted, this, &Test::onCompleted);
+        connect(&m_musicScrape, &QMusicScrape::networkError, this, &Test::onNetworkError);
+
+        // the first result is stale right away
+        m_musicScrape.setCache(&m_cache);
+        m_musicScrape.setCacheTtl(QMusicScrape::BandcampAlbumInfo, 0);
+        m_musicScrape.bandcampAlbumInfo(m_server.url("/album/cinder"));
+    }
+
+    void verify()
+    {
+        const QMusicScrapeCache::Stats stats = m_cache.stats();
+        std::cout << "requests " << m_server.requests() << ", full " << m_full << ", not modified " << m_notModified
+                  << ", cache hits " << stats.hits << ", revalidations " << stats.revalidations << std::endl;
+        check(m_step == 3, "only " + std::to_string(m_step) + " of 3 requests completed");
+    }
+
+private:
+    void onCompleted(QMusicScrape::RequestId id, const ScrapeBandcamp::ResultList &results)
+    {
+        check(results.size() == EXPECTED_TRACKS, "request " + std::to_string(id) + ": expected "
+              + std::to_string(EXPECTED_TRACKS) + " tracks, got " + std::to_string(results.size()));
+
+        const QMusicScrapeCache::Stats stats = m_cache.stats();
+        switch (++m_step) {
+        case 1:
+            check(m_full == 1 && m_notModified == 0, "the first request didn't download the page");
+
+            // revalidate, and keep the entry fresh afterwards
+            m_musicScrape.setCacheTtl(QMusicScrape::BandcampAlbumInfo, 60 * 60);
+            m_musicScrape.bandcampAlbumInfo(m_server.url("/album/cinder"));
+            break;
+        case 2:
+            check(m_full == 1 && m_notModified == 1 && stats.revalidations == 1,
+                  "the stale entry wasn't revalidated with If-None-Match");
+            m_musicScrape.bandcampAlbumInfo(m_server.url("/album/cinder"));
+            break;
+        case 3:
+            check(m_server.requests() == 2 && stats.hits == 1, "the revalidated entry wasn't served from the cache");
+            QCoreApplication::quit();
+            break;
+        }
+    }
+
+    void onNetworkError(QMusicScrape::RequestId id, QNetworkReply::NetworkError error)
+    {
+        fail("request " + std::to_string(id) + ": network error " + std::to_string(error));
+        QCoreApplication::quit();
+    }
+
+    TestServer::Response respond(const TestServer::Request &request)
+    {
+        TestServer::Response response;
+        response.headers = QByteArray("ETag: ") + ETAG + "\r\n";
+        if (request.headers.value("if-none-match") == ETAG) {
+            m_notModified++;
+            response.status = "304 Not Modified";
+        }
+        else {
+            m_full++;
+            response.headers += "Content-Type: text/html; charset=utf-8\r\n";
+            response.body = m_page;
+        }
+        return response;
+    }
+
+    QByteArray m_page;
+    TestServer m_server;
+    QMusicScrapeCache m_cache;
+    QMusicScrape m_musicScrape;     // destroyed before the cache it uses
+    int m_step;
+    int m_full;
+    int m_notModified;
+};
+
+int main(int argc, char **argv)
+{
+    return runTest<Test>(argc, argv, "bandcamp_album.html");
+}
@@ -0,0 +1,163 @@
+// Copyright (c) 2020 Wieland Hagen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Runs a multi-page Bandcamp search against a local HTTP server, whose pages complete in reverse
+// order, and the second of which is the last one. Checks that the results of the first two pages
+// are reported merged in rank order, and that the third page is left out. The search runs three
+// times: downloaded, revalidated with 304 responses, and from fresh cache entries. The last page
+// has to be recognized from the cached pages as well.
+
+#include <QNetworkAccessManager>
+#include <QUrlQuery>
+
+#include "qmusicscrape.hpp"
+#include "testserver.hpp"
+
+static const int PAGES = 3;
+static const int LAST_PAGE = 2;
+static const size_t RESULTS_PER_PAGE = 15;     // see corpus.txt
+static const int RUNS = 3;
+static const char *ETAG = "\"marrow-1\"";
+
+// sends all requests to the local server instead
+class RedirectingNetworkAccessManager : public QNetworkAccessManager
+{
+public:
+    RedirectingNetworkAccessManager(quint16 port)
+        : m_port(port)
+    {
+    }
+
+protected:
+    QNetworkReply *createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData) override
+    {
+        QUrl url = request.url();
+        url.setScheme("http");
+        url.setHost("127.0.0.1");
+        url.setPort(m_port);
+
+        QNetworkRequest redirected(request);
+        redirected.setUrl(url);
+        return QNetworkAccessManager::createRequest(op, redirected, outgoingData);
+    }
+
+private:
+    quint16 m_port;
+};
+
+class Test : public TestCase
+{
+public:
+    Test(const QByteArray &page)
+        : m_page(page)
+        , m_server([this](const TestServer::Request &request) { return respond(request); })
+        , m_network(m_server.port())
+        , m_runs(0)
+        , m_notModified(0)
+    {
+        connect(&m_musicScrape, &QMusicScrape::bandcampRequestCompleted, this, &Test::onCompleted);
+        connect(&m_musicScrape, &QMusicScrape::networkError, this, &Test::onNetworkError);
+
+        // the pages of the first run are stale right away
+        m_musicScrape.setNetworkAccessManager(&m_network);
+        m_musicScrape.setCache(&m_cache);
+        m_musicScrape.setCacheTtl(QMusicScrape::BandcampSearch, 0);
+        m_musicScrape.bandcampSearch("marrow", ScrapeBandcamp::AllItems, PAGES);
+    }
+
+    void verify()
+    {
+        check(m_runs == RUNS, "only " + std::to_string(m_runs) + " of " + std::to_string(RUNS) + " searches completed");
+    }
+
+private:
+    void onCompleted(QMusicScrape::RequestId, const ScrapeBandcamp::ResultList &results)
+    {
+        const std::string run = "run " + std::to_string(++m_runs) + ": ";
+        std::cout << run << "requests " << m_server.requests() << ", not modified " << m_notModified
+                  << ", results " << results.size() << std::endl;
+        check(results.size() == LAST_PAGE * RESULTS_PER_PAGE, run + "unexpected number of results");
+
+        // results are marked with the number of their page
+        for (size_t i = 0; i < results.size(); ++i) {
+            const std::string prefix = "https://p" + std::to_string(1 + i / RESULTS_PER_PAGE) + ".";
+            check(results[i].url.compare(0, prefix.size(), prefix) == 0,
+                  run + "result " + std::to_string(i) + " out of order: " + results[i].url);
+        }
+
+        switch (m_runs) {
+        case 1:
+            check(m_server.requests() == PAGES, run + "not all pages were requested at once");
+            m_musicScrape.setCacheTtl(QMusicScrape::BandcampSearch, 60 * 60);
+            m_musicScrape.bandcampSearch("marrow", ScrapeBandcamp::AllItems, PAGES);
+            break;
+        case 2:
+            check(m_server.requests() == 2 * PAGES && m_notModified == PAGES, run + "the pages weren't revalidated");
+            m_musicScrape.bandcampSearch("marrow", ScrapeBandcamp::AllItems, PAGES);
+            break;
+        default:
+            check(m_server.requests() == 2 * PAGES, run + "the pages weren't served from the cache");
+            QCoreApplication::quit();
+            break;
+        }
+    }
+
+    void onNetworkError(QMusicScrape::RequestId id, QNetworkReply::NetworkError error)
+    {
+        fail("request " + std::to_string(id) + ": network error " + std::to_string(error));
+        QCoreApplication::quit();
+    }
+
+    TestServer::Response respond(const TestServer::Request &request)
+    {
+        const QUrlQuery query(QUrl::fromEncoded(request.path));
+        const int page = query.hasQueryItem("page") ? query.queryItemValue("page").toInt() : 1;
+
+        TestServer::Response response;
+        response.headers = QByteArray("ETag: ") + ETAG + "\r\n";
+        response.delayMs = 50 * (PAGES - page + 1);
+        if (request.headers.value("if-none-match") == ETAG) {
+            m_notModified++;
+            response.status = "304 Not Modified";
+            return response;
+        }
+
+        response.headers += "Content-Type: text/html; charset=utf-8\r\n";
+        response.body = m_page;
+        response.body.replace("https://", "https://p" + QByteArray::number(page) + ".");
+        if (page >= LAST_PAGE)
+            response.body.replace("class=\"next\"", "class=\"disabled\"");
+        return response;
+    }
+
+    QByteArray m_page;
+    TestServer m_server;
+    RedirectingNetworkAccessManager m_network;
+    QMusicScrapeCache m_cache;
+    QMusicScrape m_musicScrape;     // destroyed before the network access manager and cache it uses
+    int m_runs;
+    int m_notModified;
+};
+
+int main(int argc, char **argv)
+{
+    return runTest<Test>(argc, argv, "bandcamp_search.html");
+}
@@ -29,7 +29,7 @@
 using std::string;
 using std::vector;
 
-static string httpGet(const string &url)
+static QByteArray httpGet(const string &url)
 {
     QNetworkAccessManager mgr;
     mgr.setRedirectPolicy(QNetworkRequest::NoLessSafeRedirectPolicy);
@@ -41,7 +41,7 @@ static string httpGet(const string &url)
     }
 
     reply->deleteLater();
-    return string(reply->readAll().data());
+    return reply->readAll();
 }
 
 static void printResults(const vector<ScrapeBandcamp::Result> &results)
@@ -68,8 +68,8 @@ int main(int argc, char **argv)
 
     {
         const string searchUrl = ScrapeBandcamp::searchUrl("cloudkicker");
-        const string html = httpGet(searchUrl);
-        const vector<ScrapeBandcamp::Result> searchResults = ScrapeBandcamp::searchResult(html);
+        const QByteArray html = httpGet(searchUrl);
+        const vector<ScrapeBandcamp::Result> searchResults = ScrapeBandcamp::searchResult(html.constData(), html.size());
         std::cout << "Search Results" << std::endl;
         printResults(searchResults);
     }
@@ -77,24 +77,24 @@ int main(int argc, char **argv)
     {
         const string artist = "https://cloudkicker.bandcamp.com/";
         const string fetchUrl = ScrapeBandcamp::bandInfoUrl(artist);
-        const string html = httpGet(fetchUrl);
-        const vector<ScrapeBandcamp::Result> bandResults = ScrapeBandcamp::bandInfoResult(artist, html);
+        const QByteArray html = httpGet(fetchUrl);
+        const vector<ScrapeBandcamp::Result> bandResults = ScrapeBandcamp::bandInfoResult(artist, html.constData(), html.size());
         std::cout << std::endl << "Albums" << std::endl;
         printResults(bandResults);
     }
 
     {
         const string album = "https://cloudkicker.bandcamp.com/album/beacons";
-        const string html = httpGet(album);
-        const vector<ScrapeBandcamp::Result> tracks = ScrapeBandcamp::albumInfo(html);
+        const QByteArray html = httpGet(album);
+        const vector<ScrapeBandcamp::Result> tracks = ScrapeBandcamp::albumInfo(html.constData(), html.size());
         std::cout << std::endl << "Tracks" << std::endl;
         printResults(tracks);
     }
 
     {
         const string searchUrl = ScrapeYoutube::searchUrl("cloudkicker");
-        const string html = httpGet(searchUrl);
-        const vector<ScrapeYoutube::Result> results = ScrapeYoutube::searchResult(html);
+        const QByteArray html = httpGet(searchUrl);
+        const vector<ScrapeYoutube::Result> results = ScrapeYoutube::searchResult(html.constData(), html.size());
         std::cout << std::endl << "Youtube:" << std::endl;
         for (const ScrapeYoutube::Result &result : results)
             printf("  %30s %20s %s\n", result.url.data(), result.playlist.data(), result.title.data());
@@ -52,18 +52,36 @@ class Test : public QObject
 public:
     Test()
         : m_musicScrape(new QMusicScrape(this))
+        , m_youtubeNextPage(0)
     {
         connect(m_musicScrape, &QMusicScrape::bandcampRequestCompleted, this, &Test::onBandcamp);
         connect(m_musicScrape, &QMusicScrape::youtubeRequestCompleted, this, &Test::onYoutubeSearch);
+        connect(m_musicScrape, &QMusicScrape::youtubeNextPageAvailable, this, &Test::onYoutubeNextPage);
+
+        // the artist and album opened after the search are likely among its first results
+        QMusicScrape::PrefetchPolicy prefetch;
+        prefetch.topResults = 3;
+        m_musicScrape->setCache(&m_cache);
+        m_musicScrape->setPrefetchPolicy(prefetch);
 
         m_search = m_musicScrape->bandcampSearch("cloudkicker");
     }
 
+    ~Test()
+    {
+        // QObject would delete its children only after m_cache is gone
+        delete m_musicScrape;
+    }
+
 private Q_SLOTS:
     void onBandcamp(QMusicScrape::RequestId id, const std::vector<ScrapeBandcamp::Result> &results)
     {
         if (id == m_search) {
             printBandcampResults(results, "Search:");
+            m_albumSearch = m_musicScrape->bandcampSearch("cloudkicker", ScrapeBandcamp::AlbumItems, 3);
+        }
+        else if (id == m_albumSearch) {
+            printBandcampResults(results, "Album search, 3 pages:");
             m_artist = m_musicScrape->bandcampArtistInfo("https://cloudkicker.bandcamp.com/");
         }
         else if (id == m_artist) {
@@ -72,25 +90,44 @@ private Q_SLOTS:
         }
         else if (id == m_album) {
             printBandcampResults(results, "Album:");
+            m_discography = m_musicScrape->bandcampDiscography("https://cloudkicker.bandcamp.com/");
+        }
+        else if (id == m_discography) {
+            printBandcampResults(results, "Discography:");
             m_youtube = m_musicScrape->youtubeSearch("cloudkicker");
         }
     }
 
+    void onYoutubeNextPage(QMusicScrape::RequestId id, const ScrapeYoutube::Continuation &continuation)
+    {
+        if (id == m_youtube)
+            m_youtubeNextPage = m_musicScrape->youtubeNextPage(continuation);
+    }
+
     void onYoutubeSearch(QMusicScrape::RequestId id, const std::vector<ScrapeYoutube::Result> &results)
     {
-        std::cout << std::endl << "Youtube:" << std::endl;
+        std::cout << std::endl << (id == m_youtube ? "Youtube:" : "Youtube, next page:") << std::endl;
         for (const ScrapeYoutube::Result &result : results)
             printf("  %30s %20s %s\n", result.url.data(), result.playlist.data(), result.title.data());
 
-        QCoreApplication::quit();
+        if (id == m_youtubeNextPage || !m_youtubeNextPage) {
+            const QMusicScrape::PrefetchStats prefetch = m_musicScrape->prefetchStats();
+            printf("\nPrefetched %d pages, %d bytes, hit rate %.2f\n",
+                   (int) prefetch.completed, (int) prefetch.bytes, prefetch.hitRate());
+            QCoreApplication::quit();
+        }
     }
 
 private:
+    QMusicScrapeCache m_cache;
     QMusicScrape *m_musicScrape;
     QMusicScrape::RequestId m_search;
+    QMusicScrape::RequestId m_albumSearch;
     QMusicScrape::RequestId m_artist;
     QMusicScrape::RequestId m_album;
+    QMusicScrape::RequestId m_discography;
     QMusicScrape::RequestId m_youtube;
+    QMusicScrape::RequestId m_youtubeNextPage;
 };
 
 int main(int argc, char **argv)
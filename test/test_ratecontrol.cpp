@@ -0,0 +1,195 @@
+// Copyright (c) 2020 Wieland Hagen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Runs QMusicScrape against a local HTTP server that answers with 429 whenever more than
+// MAX_CONCURRENT requests are in progress, and checks that all requests still complete, that
+// the connection limit was lowered, and that retries waited for Retry-After. Then, one download
+// at a time, checks that a slow body alone doesn't count as a latency spike, but slow response
+// headers do.
+
+#include <QElapsedTimer>
+
+#include <climits>
+
+#include "qmusicscrape.hpp"
+#include "testserver.hpp"
+
+static const int REQUEST_COUNT = 20;
+static const int MAX_CONCURRENT = 2;
+static const int RESPONSE_DELAY_MS = 30;
+static const int RETRY_AFTER_MS = 1000;
+static const int WARMUP_COUNT = 5;
+static const int SLOW_DELAY_MS = 500;
+static const size_t EXPECTED_TRACKS = 12;
+
+class Test : public TestCase
+{
+public:
+    Test(const QByteArray &page)
+        : m_page(page)
+        , m_server([this](const TestServer::Request &request) { return respond(request); })
+        , m_phase(Throttle)
+        , m_completed(0)
+        , m_throttled(0)
+        , m_limitAtThrottle(0)
+        , m_minLimitAfterThrottle(INT_MAX)
+        , m_minRetryWait(LLONG_MAX)
+        , m_backoffs(0)
+    {
+        connect(&m_musicScrape, &QMusicScrape::bandcampRequestCompleted, this, &Test::onCompleted);
+        connect(&m_musicScrape, &QMusicScrape::networkError, this, &Test::onNetworkError);
+        m_clock.start();
+
+        m_musicScrape.setMaxConnectionsPerHost(8);
+        for (int i = 0; i < REQUEST_COUNT; ++i)
+            m_musicScrape.bandcampAlbumInfo(m_server.url(QString("/album/%1").arg(i)), QMusicScrape::Background);
+    }
+
+    void verify()
+    {
+        const QMusicScrape::SchedulerStats stats = m_musicScrape.schedulerStats();
+        std::cout << "requests " << m_server.requests() << ", throttled " << m_throttled
+                  << ", retries " << stats.retries << ", backoffs " << stats.backoffs
+                  << ", limit " << m_limitAtThrottle << " -> " << m_minLimitAfterThrottle
+                  << ", shortest retry wait " << m_minRetryWait << " ms" << std::endl;
+        check(m_phase == Done, "stopped before all phases were done");
+    }
+
+private:
+    enum Phase
+    {
+        Throttle,   // many downloads at once, some of them throttled
+        Warmup,     // quick responses, one at a time
+        SlowBody,   // the headers arrive quickly, but the body doesn't
+        Spike,      // the headers arrive late
+        Done
+    };
+
+    void onCompleted(QMusicScrape::RequestId id, const ScrapeBandcamp::ResultList &results)
+    {
+        check(results.size() == EXPECTED_TRACKS, "request " + std::to_string(id) + ": expected "
+              + std::to_string(EXPECTED_TRACKS) + " tracks, got " + std::to_string(results.size()));
+
+        const quint64 backoffs = m_musicScrape.schedulerStats().backoffs;
+        switch (m_phase) {
+        case Throttle:
+            if (++m_completed < REQUEST_COUNT)
+                break;
+            check(m_throttled > 0, "the server never throttled");
+            check(m_musicScrape.schedulerStats().retries > 0, "throttled requests were not retried");
+            check(m_minLimitAfterThrottle < m_limitAtThrottle, "the connection limit wasn't lowered after a 429");
+            check(m_minRetryWait >= RETRY_AFTER_MS, "a throttled request was retried before its Retry-After delay");
+            m_phase = Warmup;
+            m_completed = 0;
+            next("/fast/0");
+            break;
+        case Warmup:
+            if (++m_completed < WARMUP_COUNT) {
+                next(QString("/fast/%1").arg(m_completed));
+                break;
+            }
+            m_phase = SlowBody;
+            m_backoffs = backoffs;
+            next("/slowbody");
+            break;
+        case SlowBody:
+            check(backoffs == m_backoffs, "a slow body was taken for a latency spike");
+            m_phase = Spike;
+            m_backoffs = backoffs;
+            next("/spike");
+            break;
+        case Spike:
+            check(backoffs > m_backoffs, "slow response headers didn't cause a backoff");
+            m_phase = Done;
+            QCoreApplication::quit();
+            break;
+        case Done:
+            fail("request " + std::to_string(id) + " completed after the test");
+            break;
+        }
+    }
+
+    void onNetworkError(QMusicScrape::RequestId id, QNetworkReply::NetworkError error)
+    {
+        fail("request " + std::to_string(id) + ": network error " + std::to_string(error));
+        QCoreApplication::quit();
+    }
+
+    void next(const QString &path)
+    {
+        m_musicScrape.bandcampAlbumInfo(m_server.url(path));
+    }
+
+    TestServer::Response respond(const TestServer::Request &request)
+    {
+        TestServer::Response response;
+        response.headers = "Content-Type: text/html; charset=utf-8\r\n";
+        response.body = m_page;
+
+        if (request.path.startsWith("/album/")) {
+            // limits that QMusicScrape applied after the first 429
+            const int limit = m_musicScrape.connectionLimit("127.0.0.1");
+            if (m_throttled > 0)
+                m_minLimitAfterThrottle = qMin(m_minLimitAfterThrottle, limit);
+
+            if (m_throttledAt.contains(request.path))
+                m_minRetryWait = qMin(m_minRetryWait, m_clock.elapsed() - m_throttledAt.take(request.path));
+
+            // inFlight() includes this request
+            if (m_server.inFlight() > MAX_CONCURRENT) {
+                if (m_throttled++ == 0)
+                    m_limitAtThrottle = limit;
+                m_throttledAt.insert(request.path, m_clock.elapsed());
+                response.status = "429 Too Many Requests";
+                response.headers = "Retry-After: " + QByteArray::number(RETRY_AFTER_MS / 1000) + "\r\n";
+                response.body.clear();
+            }
+            else {
+                response.delayMs = RESPONSE_DELAY_MS;
+            }
+        }
+        else if (request.path == "/slowbody") {
+            response.bodyDelayMs = SLOW_DELAY_MS;
+        }
+        else if (request.path == "/spike") {
+            response.delayMs = SLOW_DELAY_MS;
+        }
+        return response;
+    }
+
+    QByteArray m_page;
+    TestServer m_server;
+    QElapsedTimer m_clock;
+    Phase m_phase;
+    int m_completed;
+    int m_throttled;
+    int m_limitAtThrottle;
+    int m_minLimitAfterThrottle;
+    QHash<QByteArray, qint64> m_throttledAt;    // path of each throttled request, until it's retried
+    qint64 m_minRetryWait;
+    quint64 m_backoffs;     // at the start of the current phase
+    QMusicScrape m_musicScrape;
+};
+
+int main(int argc, char **argv)
+{
+    return runTest<Test>(argc, argv, "bandcamp_album.html");
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2020 Wieland Hagen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Runs QMusicScrape in RequestOrder against a local HTTP server that holds back the responses for
+// the slow pages, and checks that cancelling a request releases the results that were held back
+// behind it, and that a cancelled request whose results were held back is never reported.
+//
+// Pages are parsed synchronously, so that the results of a request are held back as soon as its
+// reply is finished. The cancels are triggered by those replies, not by timers.
+
+#include <QNetworkAccessManager>
+
+#include "qmusicscrape.hpp"
+#include "testserver.hpp"
+
+class Test : public TestCase
+{
+public:
+    Test(const QByteArray &page)
+        : m_server([page](const TestServer::Request &request) {
+              TestServer::Response response;
+              response.headers = "Content-Type: text/html; charset=utf-8\r\n";
+              response.body = page;
+              response.deferred = request.path.startsWith("/slow/");
+              return response;
+          })
+        , m_slow(0)
+        , m_heldBack(0)
+    {
+        connect(&m_musicScrape, &QMusicScrape::bandcampRequestCompleted, this, &Test::onCompleted);
+        connect(&m_musicScrape, &QMusicScrape::networkError, this, &Test::onNetworkError);
+        m_musicScrape.setThreadPool(nullptr);
+        m_musicScrape.setResultOrder(QMusicScrape::RequestOrder);
+
+        // QMusicScrape has handled a reply by the time this is called
+        connect(m_musicScrape.networkAccessManager(), &QNetworkAccessManager::finished, this, &Test::onReplyFinished);
+
+        // the slow request is cancelled once the two after it are held back
+        m_slow = m_musicScrape.bandcampAlbumInfo(m_server.url("/slow/1"));
+        m_expected << m_musicScrape.bandcampAlbumInfo(m_server.url("/fast/1"));
+        m_expected << m_musicScrape.bandcampAlbumInfo(m_server.url("/fast/2"));
+    }
+
+    void verify()
+    {
+        check(m_expected.isEmpty(), std::to_string(m_expected.size()) + " requests didn't complete");
+    }
+
+private:
+    void onReplyFinished(QNetworkReply *reply)
+    {
+        const QString path = reply->url().path();
+        if (path == "/fast/2") {
+            check(m_musicScrape.cancel(m_slow), "cancel() of a running request failed");
+            check(!m_musicScrape.cancel(m_slow), "cancel() of a cancelled request succeeded");
+        }
+        else if (path == "/fast/3") {
+            check(m_musicScrape.cancel(m_heldBack), "cancel() of a held back request failed");
+            m_server.sendDeferred();
+        }
+    }
+
+    void onCompleted(QMusicScrape::RequestId id, const ScrapeBandcamp::ResultList &)
+    {
+        if (m_expected.isEmpty() || m_expected.first() != id) {
+            fail("request " + std::to_string(id) + " completed out of order, or after it was cancelled");
+            return;
+        }
+        m_expected.removeFirst();
+        std::cout << "request " << id << " completed" << std::endl;
+        if (!m_expected.isEmpty())
+            return;
+
+        if (!m_heldBack) {
+            // then the other way around: the fast request is cancelled while it is held back
+            m_expected << m_musicScrape.bandcampAlbumInfo(m_server.url("/slow/2"));
+            m_heldBack = m_musicScrape.bandcampAlbumInfo(m_server.url("/fast/3"));
+        }
+        else {
+            // the cancelled request would have been reported right after this one
+            QTimer::singleShot(0, this, []() { QCoreApplication::quit(); });
+        }
+    }
+
+    void onNetworkError(QMusicScrape::RequestId id, QNetworkReply::NetworkError error)
+    {
+        fail("request " + std::to_string(id) + ": network error " + std::to_string(error));
+    }
+
+    TestServer m_server;
+    QMusicScrape m_musicScrape;
+    QMusicScrape::RequestId m_slow;
+    QMusicScrape::RequestId m_heldBack;
+    QList<QMusicScrape::RequestId> m_expected;  // in the order in which they are to be reported
+};
+
+int main(int argc, char **argv)
+{
+    return runTest<Test>(argc, argv, "bandcamp_album.html");
+}
@@ -0,0 +1,231 @@
+// Copyright (c) 2020 Wieland Hagen
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Harness for the offline QMusicScrape tests: a minimal HTTP/1.1 server on localhost, which
+// answers every request through a handler, and the code that runs a test against it.
+
+#ifndef INCLUDE_TESTSERVER_HPP
+#define INCLUDE_TESTSERVER_HPP
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QPointer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <functional>
+#include <iostream>
+#include <string>
+
+#ifndef MUSICSCRAPE_CORPUS_DIR
+#define MUSICSCRAPE_CORPUS_DIR "test/corpus"
+#endif
+
+static const int TEST_TIMEOUT_MS = 30 * 1000;
+
+/**
+ * Answers each request after the handler's delay, or once sendDeferred() is called, and closes
+ * the connection after the response
+ */
+class TestServer
+{
+public:
+    struct Request
+    {
+        QByteArray path;                        // including the query
+        QHash<QByteArray, QByteArray> headers;  // with lower case names
+    };
+
+    struct Response
+    {
+        Response() : status("200 OK"), delayMs(0), bodyDelayMs(0), deferred(false) {}
+
+        QByteArray status;
+        QByteArray headers;     // additional header lines, each terminated by \r\n
+        QByteArray body;
+        int delayMs;
+        int bodyDelayMs;        // between the headers and the body
+        bool deferred;          // held back until sendDeferred()
+    };
+
+    using Handler = std::function<Response(const Request &request)>;
+
+    TestServer(const Handler &handler)
+        : m_handler(handler)
+        , m_requests(0)
+        , m_inFlight(0)
+    {
+        QObject::connect(&m_server, &QTcpServer::newConnection, &m_server, [this]() { onNewConnection(); });
+        m_server.listen(QHostAddress::LocalHost);
+    }
+
+    quint16 port() const { return m_server.serverPort(); }
+    QString url(const QString &path) const { return QString("http://127.0.0.1:%1%2").arg(port()).arg(path); }
+
+    int requests() const { return m_requests; }
+
+    /**
+     * Requests that were received, but not answered yet, including the one being handled
+     */
+    int inFlight() const { return m_inFlight; }
+
+    void sendDeferred()
+    {
+        const QList<QPair<QPointer<QTcpSocket>, Response>> deferred = m_deferred;
+        m_deferred.clear();
+        for (const auto &pending : deferred)
+            respond(pending.first, pending.second);
+    }
+
+private:
+    void onNewConnection()
+    {
+        while (QTcpSocket *socket = m_server.nextPendingConnection()) {
+            QObject::connect(socket, &QTcpSocket::readyRead, &m_server, [=]() { onReadyRead(socket); });
+            QObject::connect(socket, &QTcpSocket::disconnected, &m_server, [=]() { m_buffers.remove(socket); });
+            QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        }
+    }
+
+    void onReadyRead(QTcpSocket *socket)
+    {
+        QByteArray &data = m_buffers[socket];
+        data += socket->readAll();
+        const int headerEnd = data.indexOf("\r\n\r\n");
+        if (headerEnd < 0)
+            return;
+
+        Request request;
+        const QList<QByteArray> lines = data.left(headerEnd).split('\n');
+        request.path = lines.value(0).trimmed().split(' ').value(1);
+        for (int i = 1; i < lines.size(); ++i) {
+            const int colon = lines[i].indexOf(':');
+            if (colon > 0)
+                request.headers.insert(lines[i].left(colon).trimmed().toLower(), lines[i].mid(colon + 1).trimmed());
+        }
+        m_buffers.remove(socket);
+        m_requests++;
+        m_inFlight++;
+
+        const Response response = m_handler(request);
+        const QPointer<QTcpSocket> guard(socket);
+        if (response.deferred)
+            m_deferred << qMakePair(guard, response);
+        else if (response.delayMs > 0)
+            QTimer::singleShot(response.delayMs, &m_server, [=]() { respond(guard, response); });
+        else
+            respond(guard, response);
+    }
+
+    void respond(QTcpSocket *socket, const Response &response)
+    {
+        m_inFlight--;
+        if (!socket)
+            return;
+        socket->write("HTTP/1.1 " + response.status + "\r\n" + response.headers
+                      + "Content-Length: " + QByteArray::number(response.body.size()) + "\r\n"
+                      + "Connection: close\r\n\r\n");
+        if (response.bodyDelayMs > 0) {
+            const QPointer<QTcpSocket> guard(socket);
+            QTimer::singleShot(response.bodyDelayMs, &m_server, [=]() { sendBody(guard, response.body); });
+        }
+        else {
+            sendBody(socket, response.body);
+        }
+    }
+
+    static void sendBody(QTcpSocket *socket, const QByteArray &body)
+    {
+        if (!socket)
+            return;
+        socket->write(body);
+        socket->disconnectFromHost();
+    }
+
+    QTcpServer m_server;
+    Handler m_handler;
+    QHash<QTcpSocket*, QByteArray> m_buffers;
+    QList<QPair<QPointer<QTcpSocket>, Response>> m_deferred;
+    int m_requests;
+    int m_inFlight;
+};
+
+/**
+ * Base of the tests, which counts the failed checks
+ */
+class TestCase : public QObject
+{
+public:
+    TestCase()
+        : m_failures(0)
+    {
+    }
+
+    int failures() const { return m_failures; }
+
+    void fail(const std::string &message)
+    {
+        std::cerr << message << std::endl;
+        m_failures++;
+    }
+
+    void check(bool condition, const std::string &message)
+    {
+        if (!condition)
+            fail(message);
+    }
+
+private:
+    int m_failures;
+};
+
+/**
+ * Reads the page from the corpus, constructs the Test with it, and runs the event loop until the
+ * test calls QCoreApplication::quit(), or times out. Then Test::verify() checks the final state.
+ * Returns the exit code of the test.
+ */
+template <class Test>
+int runTest(int argc, char **argv, const char *corpusFile)
+{
+    QCoreApplication app(argc, argv);
+
+    const QString path = QString(MUSICSCRAPE_CORPUS_DIR "/") + corpusFile;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::cerr << "Can't read " << path.toStdString() << std::endl;
+        return 1;
+    }
+
+    Test test(file.readAll());
+    QTimer::singleShot(TEST_TIMEOUT_MS, &test, [&]() {
+        test.fail("timeout");
+        QCoreApplication::quit();
+    });
+
+    app.exec();
+    test.verify();
+    return test.failures() ? 1 : 0;
+}
+
+#endif // INCLUDE_TESTSERVER_HPP